@@ -7,9 +7,12 @@
 #include <alloca.h>
 #include <malloc.h>
 #include <string.h>
+#include <pthread.h>
 
+#include <new>
 #include <numeric>
 #include <iterator>
+#include <algorithm>
 
 // https://github.com/gcc-mirror/gcc/blob/master/libstdc++-v3/libsupc++/unwind-cxx.h
 #undef _GLIBCXX_HAVE_SYS_SDT_H
@@ -147,45 +150,296 @@ bool CheckExceptionHandler(void* context, const std::type_info& type, std::size_
 
 #define EXCEPTION_TRACE_MAGIC  0xaec5b15b7c84baeeULL
 
+#define EXCEPTION_POOL_BLOCK    256U  // Size of the smallest class
+#define EXCEPTION_POOL_CLASSES  5     // Classes of 256 .. 4096 bytes, bigger ones go to malloc()
+#define EXCEPTION_POOL_LIMIT    32    // Count of free blocks kept per class
+
+#define EXCEPTION_RESERVE_SIZE   1024
+#define EXCEPTION_RESERVE_COUNT  32   // Has to fit ReservedExceptionMap
+
+struct ExceptionPool;
+
 struct TraceableException
 {
   struct ExceptionTrace trace;
-  uint64_t alignment;
+  struct ExceptionPool* pool;     // Owner of the block, nullptr for heap and reserved blocks
+  TraceableException* next;       // Link in free lists of the pool
+  uint32_t number;                // Size class
+  uint32_t alignment;
   uint64_t magic;
   __cxxabiv1::__cxa_refcounted_exception exception;
   char data[0];
 };
 
+struct ExceptionPool
+{
+  std::atomic<TraceableException*> returned;         // Blocks freed by other threads
+  std::atomic<uintptr_t> references;                 // Blocks in use + 1 for the owner thread
+  TraceableException* blocks[EXCEPTION_POOL_CLASSES];
+  unsigned counts[EXCEPTION_POOL_CLASSES];
+};
+
 typedef void* (*AllocateExceptionFunction)(std::size_t size) noexcept;
 typedef void (*FreeExceptionFunction)(void* pointer) noexcept;
 
 static AllocateExceptionFunction AllocateException = nullptr;
 static FreeExceptionFunction     FreeException     = nullptr;
 
+static pthread_key_t ExceptionPoolKey;
+static bool          ExceptionPoolReady = false;
+
+static thread_local ExceptionPool* CurrentExceptionPool = nullptr;
+
+static std::atomic<uint32_t> ReservedExceptionMap(0);
+static char ReservedExceptionData[EXCEPTION_RESERVE_COUNT][EXCEPTION_RESERVE_SIZE] __attribute__((aligned(__BIGGEST_ALIGNMENT__)));
+
 std::atomic<unsigned> ExceptionTraceDepth(0);
 
+static void FreeExceptionList(TraceableException* exception) noexcept
+{
+  TraceableException* next;
+
+  while (exception != nullptr)
+  {
+    next = exception->next;
+    free(exception);
+    exception = next;
+  }
+}
+
+static void ReleaseExceptionPool(void* data) noexcept
+{
+  ExceptionPool* pool;
+  unsigned number;
+
+  // Called on thread exit, blocks still in use keep the pool until the last of them is freed
+
+  pool                 = static_cast<ExceptionPool*>(data);
+  CurrentExceptionPool = nullptr;
+
+  for (number = 0; number < EXCEPTION_POOL_CLASSES; number ++)
+  {
+    FreeExceptionList(pool->blocks[number]);
+    pool->blocks[number] = nullptr;
+    pool->counts[number] = 0;
+  }
+
+  FreeExceptionList(pool->returned.exchange(nullptr, std::memory_order_acquire));
+
+  if (pool->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    FreeExceptionList(pool->returned.exchange(nullptr, std::memory_order_acquire));
+    free(pool);
+  }
+}
+
 static void __attribute__((constructor(103))) Initialize()
 {
-  AllocateException = reinterpret_cast<AllocateExceptionFunction>(dlsym(RTLD_NEXT, "__cxa_allocate_exception"));
-  FreeException     = reinterpret_cast<  FreeExceptionFunction  >(dlsym(RTLD_NEXT, "__cxa_free_exception"));
+  AllocateException  = reinterpret_cast<AllocateExceptionFunction>(dlsym(RTLD_NEXT, "__cxa_allocate_exception"));
+  FreeException      = reinterpret_cast<  FreeExceptionFunction  >(dlsym(RTLD_NEXT, "__cxa_free_exception"));
+  ExceptionPoolReady = pthread_key_create(&ExceptionPoolKey, ReleaseExceptionPool) == 0;
+}
+
+static ExceptionPool* GetExceptionPool() noexcept
+{
+  void* memory;
+  ExceptionPool* pool;
+
+  pool = CurrentExceptionPool;
+
+  if ((pool   == nullptr) &&
+      (ExceptionPoolReady) &&
+      (memory  = calloc(1, sizeof(ExceptionPool))))
+  {
+    pool = new (memory) ExceptionPool();
+    pool->references.store(1, std::memory_order_relaxed);
+
+    if (pthread_setspecific(ExceptionPoolKey, pool) != 0)
+    {
+      free(pool);
+      return nullptr;
+    }
+
+    CurrentExceptionPool = pool;
+  }
+
+  return pool;
+}
+
+static void CollectReturnedExceptions(ExceptionPool* pool) noexcept
+{
+  TraceableException* exception;
+  TraceableException* next;
+
+  exception = pool->returned.exchange(nullptr, std::memory_order_acquire);
+
+  while (exception != nullptr)
+  {
+    next = exception->next;
+
+    if (pool->counts[exception->number] < EXCEPTION_POOL_LIMIT)
+    {
+      exception->next = pool->blocks[exception->number];
+      pool->blocks[exception->number] = exception;
+      pool->counts[exception->number] ++;
+    }
+    else
+    {
+      // Too many blocks of the class are cached already
+      free(exception);
+    }
+
+    exception = next;
+  }
+}
+
+static TraceableException* AllocateTraceableException(std::size_t length) noexcept
+{
+  unsigned number;
+  ExceptionPool* pool;
+  TraceableException* exception;
+
+  for (number = 0; (number < EXCEPTION_POOL_CLASSES) && ((EXCEPTION_POOL_BLOCK << number) < length); number ++);
+
+  if ((number == EXCEPTION_POOL_CLASSES) ||
+      (pool    = GetExceptionPool()) == nullptr)
+  {
+    // Too big for the pool or the pool is not available, use heap
+    if ((exception = static_cast<TraceableException*>(malloc(length))))
+      exception->pool = nullptr;
+
+    return exception;
+  }
+
+  if (pool->blocks[number] == nullptr)
+  {
+    // Take blocks freed by other threads
+    CollectReturnedExceptions(pool);
+  }
+
+  if ((exception = pool->blocks[number]))
+  {
+    pool->blocks[number] = exception->next;
+    pool->counts[number] --;
+  }
+  else if ((exception = static_cast<TraceableException*>(malloc(EXCEPTION_POOL_BLOCK << number))) == nullptr)
+  {
+    // Out of memory
+    return nullptr;
+  }
+
+  pool->references.fetch_add(1, std::memory_order_relaxed);
+
+  exception->pool   = pool;
+  exception->number = number;
+
+  return exception;
+}
+
+static TraceableException* ClaimReservedException() noexcept
+{
+  uint32_t map;
+  unsigned number;
+  TraceableException* exception;
+
+  map = ReservedExceptionMap.load(std::memory_order_relaxed);
+
+  while (~map != 0)
+  {
+    number = __builtin_ctz(~map);
+
+    if (ReservedExceptionMap.compare_exchange_weak(map, map | (1U << number), std::memory_order_acquire, std::memory_order_relaxed))
+    {
+      exception       = reinterpret_cast<TraceableException*>(ReservedExceptionData[number]);
+      exception->pool = nullptr;
+      return exception;
+    }
+  }
+
+  return nullptr;
+}
+
+static void ReleaseTraceableException(TraceableException* exception) noexcept
+{
+  char* address;
+  ExceptionPool* pool;
+  TraceableException* head;
+
+  pool = exception->pool;
+
+  if (pool == nullptr)
+  {
+    address = reinterpret_cast<char*>(exception);
+
+    if ((address >= ReservedExceptionData[0]) &&
+        (address <  ReservedExceptionData[EXCEPTION_RESERVE_COUNT]))
+    {
+      ReservedExceptionMap.fetch_and(~(1U << ((address - ReservedExceptionData[0]) / EXCEPTION_RESERVE_SIZE)), std::memory_order_release);
+      return;
+    }
+
+    free(exception);
+    return;
+  }
+
+  if (pool == CurrentExceptionPool)
+  {
+    // Owner thread, the pool cannot be released meanwhile
+    if (pool->counts[exception->number] < EXCEPTION_POOL_LIMIT)
+    {
+      exception->next = pool->blocks[exception->number];
+      pool->blocks[exception->number] = exception;
+      pool->counts[exception->number] ++;
+    }
+    else
+    {
+      // Too many blocks of the class are cached already
+      free(exception);
+    }
+
+    pool->references.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Another thread, return the block to the owner
+
+  head = pool->returned.load(std::memory_order_relaxed);
+
+  do exception->next = head;
+  while (!pool->returned.compare_exchange_weak(head, exception, std::memory_order_release, std::memory_order_relaxed));
+
+  if (pool->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    // The owner has already gone
+    FreeExceptionList(pool->returned.exchange(nullptr, std::memory_order_acquire));
+    free(pool);
+  }
 }
 
 extern "C" void* __cxxabiv1::__cxa_allocate_exception(std::size_t size) noexcept
 {
   unsigned depth;
+  std::size_t length;
   unw_word_t address;
   unw_cursor_t cursor;
   unw_context_t context;
   TraceableException* exception;
 
-  depth     = ExceptionTraceDepth.load(std::memory_order_relaxed);
-  exception = static_cast<TraceableException*>(malloc(sizeof(TraceableException) + size + depth * sizeof(void*) + __BIGGEST_ALIGNMENT__));
+  size  +=  (__BIGGEST_ALIGNMENT__ - 1ULL);
+  size  &= ~(__BIGGEST_ALIGNMENT__ - 1ULL);
+  depth  = ExceptionTraceDepth.load(std::memory_order_relaxed);
+  length = sizeof(TraceableException) + size;
 
-  if (exception != nullptr)
+  if (((exception = AllocateTraceableException(length + depth * sizeof(void*))) == nullptr) &&
+      (length    <= EXCEPTION_RESERVE_SIZE) &&
+      (exception  = ClaimReservedException()))
   {
-    size +=  (__BIGGEST_ALIGNMENT__ - 1ULL);
-    size &= ~(__BIGGEST_ALIGNMENT__ - 1ULL);
+    // Out of memory, truncate the trace to fit the reserved block
+    depth = std::min<std::size_t>(depth, (EXCEPTION_RESERVE_SIZE - length) / sizeof(void*));
+  }
 
+  if (exception != nullptr)
+  {
     exception->magic       = EXCEPTION_TRACE_MAGIC;
     exception->trace.begin = reinterpret_cast<void**>(exception->data + size);
     exception->trace.end   = exception->trace.begin;
@@ -225,7 +479,7 @@ extern "C" void __cxxabiv1::__cxa_free_exception(void* pointer) noexcept
   if ((exception->magic       == EXCEPTION_TRACE_MAGIC) &&
       (exception->trace.begin <= exception->trace.end))
   {
-    free(exception);
+    ReleaseTraceableException(exception);
     return;
   }
 
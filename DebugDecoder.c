@@ -5,72 +5,569 @@
 // https://www.prevanders.net/libdwarfdoc/index.html
 
 #include <stdatomic.h>
+#include <inttypes.h>
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <link.h>
 
+#include <time.h>
+#include <errno.h>
 #include <signal.h>
+#include <sched.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include <gelf.h>
 #include <libelf.h>
 #include <libdwarf/dwarf.h>
 #include <elfutils/debuginfod.h>
 
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+
 #include <stdlib.h>
 #include <stdio.h>
 
+#if __has_include(<lzma.h>)
+#include <lzma.h>
+
+// MiniDebugInfo is decompressed only when liblzma is linked to the process
+#pragma weak lzma_stream_decoder
+#pragma weak lzma_code
+#pragma weak lzma_end
+#endif
+
+// Names are demangled only when C++ runtime is linked to the process
+char* __cxa_demangle(const char* name, char* buffer, size_t* length, int* status) __attribute__((weak));
+
 //  DW_LIBDWARF_VERSION "0.11.1"
 
+#ifndef DW_TAG_skeleton_unit
+// DWARF 5 split units are not known by old libdwarf
+#define DW_TAG_skeleton_unit  0x4a
+#define DW_AT_dwo_name        0x76
+#endif
+
+#define SOURCE_BLOCK_SIZE     16
+#define DEBUG_MISS_ORDER      6
+#define DEBUG_SCRATCH_SIZE    4096
+#define DEBUG_LOADER_LIMIT    8
+
+#define DEBUG_FETCH_LIMIT     2
+#define DEBUG_FETCH_TIMEOUT   120   // Seconds per download
+#define DEBUG_FETCH_BACKOFF   30    // Seconds before the first retry, doubled by every failure
+#define DEBUG_FETCH_PATIENCE  3600  // The longest delay between retries
+
+#define DEBUG_RETIRE_SOURCE   0
+#define DEBUG_RETIRE_INDEX    1
+#define DEBUG_RETIRE_SYMBOLS  2
+#define DEBUG_RETIRE_ARENA    3
+
+#define DEBUG_COUNTER_HITS         0
+#define DEBUG_COUNTER_MISSES       1
+#define DEBUG_COUNTER_EVICTIONS    2
+#define DEBUG_COUNTER_ARANGES      3
+#define DEBUG_COUNTER_SCANS        4
+#define DEBUG_COUNTER_WALKS        5
+#define DEBUG_COUNTER_CONTENTIONS  6
+#define DEBUG_COUNTER_FETCHES      7
+#define DEBUG_COUNTER_FAILURES     8
+#define DEBUG_COUNTER_NEGATIVES    9
+#define DEBUG_COUNTER_TIMES        10  // DEBUG_TIER_* nanoseconds follow the counters
+#define DEBUG_COUNTER_COUNT        (DEBUG_COUNTER_TIMES + DEBUG_TIER_COUNT)
+
+#define DEBUG_SYMBOLIZER_CHUNK  256   // The smallest count of requests taken by a worker at once
+
+#define DEBUG_BUILDER_WEIGHT  (64 << 20)  // The smallest DWARF worth building by several workers
+#define DEBUG_BUILDER_LIMIT   8           // Every worker keeps its own copy of DWARF loaded by libdwarf
+
+#define DEBUG_HELPER_RING_SIZE  64    // Power of two
+#define DEBUG_HELPER_NAME_SIZE  PATH_MAX
+
+#define DEBUG_HELPER_STOP  0
+#define DEBUG_HELPER_RUN   1
+
+#define DEBUG_SLOT_FREE       0
+#define DEBUG_SLOT_REQUEST    1
+#define DEBUG_SLOT_ANSWER     2
+#define DEBUG_SLOT_ABANDONED  3
+
+#define DEBUG_TRACE_INLINE  8   // The deepest chain of inlined frames printed for a frame of the stack
+
+#define DEBUG_FRAME_ORDER   12  // Slots of the frame cache
+#define DEBUG_FRAME_PROBES  4   // Slots probed for an address, the home slot is replaced when all are taken
+#define DEBUG_FRAME_PERIOD  10  // Milliseconds between checks of the module map by hits of the frame cache
+
+#define DEBUG_FRAME_SOURCE  1
+#define DEBUG_FRAME_SYMBOL  2
+
+#define DEBUG_SHARD_COUNT  16  // Power of two, reader counts and counters are spread by CPU
+#define DEBUG_LINE_SIZE    64
+
+#define DEBUG_CACHE_MAGIC    0x5845444e49474244ULL  // DBGINDEX
+#define DEBUG_CACHE_VERSION  3
+
 struct SourceLine
 {
   Dwarf_Addr address;
-  Dwarf_Line* line;
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
 };
 
-struct SourceCache
+struct SourceRow
 {
-  struct SourceCache* next;
+  uint32_t offset;  // Delta from the base address of the block
+  uint32_t file;    // Index in the file table of the compilation unit
+  uint32_t line;
+  uint32_t column;
+};
 
-  Dwarf_Die entry;
+struct SourceBlock
+{
+  Dwarf_Addr limit;  // Address of the last row in the block
+  uint32_t offset;   // Delta between the last and the first rows
+  uint32_t number;   // Position of the block in the address order
+};
+
+struct SourceFrame
+{
+  Dwarf_Addr low;
+  Dwarf_Addr high;
+  uint32_t parent;   // Enclosing frame, always goes before, UINT32_MAX for the outermost one
+  uint32_t number;   // Position of the entry in DIE order, used only to build the table
+  uint32_t name;     // Index in the name table of the compilation unit
+  uint32_t file;     // Call site of inlined subroutine, index in the file table
+  uint32_t line;     //   -- // --
+  uint32_t column;   //   -- // --
+};
+
+struct SourceTable
+{
   Dwarf_Off offset;
-  Dwarf_Small count;
-  Dwarf_Line_Context context;
 
-  Dwarf_Signed length;
-  struct SourceLine* list;
+  size_t length;               // Rows sorted by address, SOURCE_BLOCK_SIZE rows per block
+  struct SourceRow* rows;      //   -- // --
+
+  size_t count;                // Block bases in Eytzinger layout, 1-based
+  struct SourceBlock* blocks;  //   -- // --
+
+  size_t number;               // File table, paths are interned by the unit
+  const char** files;          //   -- // --
+  uint32_t* identifiers;       // Process-wide identifiers of files, 1-based
+
+  size_t span;                 // Ranges of functions and inlined subroutines sorted by address,
+  struct SourceFrame* frames;  // nested ranges follow the enclosing ones
+
+  size_t total;                // Function names, interned by the unit
+  const char** names;          //   -- // --
+};
+
+struct DebugRange
+{
+  Dwarf_Addr low;
+  Dwarf_Addr high;
+  Dwarf_Off offset;  // Offset of CU DIE
+  size_t number;     // Slot of compilation unit in the index
+};
+
+struct SourceSlot
+{
+  Dwarf_Off offset;        // Offset of CU DIE
+  atomic_uintptr_t table;  // struct SourceTable*, immutable after publishing, could be evicted
+  atomic_uint stamp;       // Tick of the last use
+};
+
+struct DebugIndex
+{
+  size_t length;              // Disjoint ranges sorted by address
+  struct DebugRange* ranges;  //   -- // --
+
+  size_t count;               // Compilation units sorted by offset
+  struct SourceSlot* slots;   //   -- // --
+
+  size_t size;                // Mapping of persistent index, ranges, rows and blocks point into it
+  void* mapping;              //   -- // --
+};
+
+struct DebugCacheHeader
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t width;             // Size of pointer
+  uint32_t size;              // Build ID
+  uint8_t identifier[64];     //   -- // --
+  uint64_t length;            // Ranges
+  uint64_t ranges;            //   -- // --
+  uint64_t count;             // Tables
+  uint64_t tables;            //   -- // --
+  uint64_t number;            // Offsets of strings, 0 for an empty slot
+  uint64_t strings;           //   -- // --
+};
+
+struct DebugCacheTable
+{
+  uint64_t offset;            // Offset of CU DIE
+  uint64_t length;            // Rows
+  uint64_t rows;              //   -- // --
+  uint64_t count;             // Blocks
+  uint64_t blocks;            //   -- // --
+  uint64_t number;            // Files, numbers of strings
+  uint64_t files;             //   -- // --
+  uint64_t span;              // Frames
+  uint64_t frames;            //   -- // --
+  uint64_t total;             // Function names, numbers of strings
+  uint64_t names;             //   -- // --
+};
+
+struct RangeList
+{
+  struct DebugRange* data;
+  size_t size;
+  size_t length;
+};
+
+struct FrameList
+{
+  struct SourceFrame* data;
+  const char** labels;    // Names of frames in DIE order, deduplicated after the walk
+  size_t size;
+  size_t length;
+
+  struct RangeList ranges;
+
+  char** files;           // File names of the line program header
+  Dwarf_Signed count;     //   -- // --
+  Dwarf_Half version;     // Version of compilation unit, numbering of files depends on it
+
+  uint32_t** map;         // File number map shared with the line table
+  size_t* number;         //   -- // --
+};
+
+struct SplitUnit
+{
+  int handle;             // |
+  Elf* module;            // | .dwo file, open only while a table is built, handle is -1 for a unit of the package
+  Dwarf_Debug instance;   // |
+  Dwarf_Die entry;        // Split compilation unit
+};
+
+struct SplitPackage
+{
+  int handle;             // |
+  Elf* module;            // | .dwp file next to the module, opened once and tied to the instance
+  Dwarf_Debug instance;   // |
+  int missing;            // Package has been looked up and not found
+};
+
+struct StringTable
+{
+  size_t size;
+  size_t count;
+  char** data;
+};
+
+struct FileRegistry
+{
+  size_t size;                  // Identifiers hashed by path, open addressing
+  uint32_t* slots;              //   -- // --
+  size_t count;                 // Paths by identifier, 0 is reserved for unknown file
+  size_t capacity;              //   -- // --
+  const char** paths;           //   -- // --
 };
 
+struct DebugShard
+{
+  atomic_uint_fast64_t counters[DEBUG_COUNTER_COUNT];  // DEBUG_COUNTER_*, relaxed
+} __attribute__((aligned(DEBUG_LINE_SIZE)));
+
+struct DebugReaders
+{
+  atomic_int counts[2];         // Readers counted by parity of epoch
+} __attribute__((aligned(DEBUG_LINE_SIZE)));
+
 struct DebugUnit
 {
   char* name;
   uintptr_t next;
   pthread_mutex_t lock;
 
+  dev_t device;                 // File of the module
+  ino_t inode;                  //   -- // --
+
+  size_t size;                  // Build ID of the module
+  uint8_t identifier[64];       //   -- // --
+
   int handle;                   // |
   Elf* module;                  // | Debug unit cache
   Dwarf_Debug instance;         // |
+  struct SplitPackage package;  // Split units of the instance, protected by lock
+  unsigned int lineage;         // Process which has opened descriptors, a forked child reopens them on first use
+
+  atomic_uintptr_t index;       // struct DebugIndex*, readers never take the lock
+  atomic_uintptr_t symbols;     // struct SymbolTable*, the same
+
+  atomic_int ready;             // Unit has been opened, until then the lock is held by the loading thread
+  char* debug;                  // Separated debug file downloaded by debuginfod
+
+  struct DebugUnit* queue;      // Next unit to fetch, protected by fetcher
+  atomic_int fetching;          // Unit is in the fetch queue
+  atomic_long retry;            // Monotonic time of the next allowed fetch
+  int failures;                 // Failed fetches in a row, protected by fetcher
+  atomic_uint stamp;            // Tick of the last use
+  atomic_int evicted;           // DWARF has been released by eviction and has to be opened again
+  size_t weight;                // Estimated size of DWARF loaded by libdwarf
+  atomic_uintptr_t misses[1 << DEBUG_MISS_ORDER];  // Negative cache of addresses without source
+  struct DebugShard shards[DEBUG_SHARD_COUNT];  // Counters of threads running on the same CPU
+
+  struct StringTable strings;   // Interned paths, live until the unit is released
+  pthread_mutex_t interner;     // Protects strings, tables could be built by several workers at once
+  struct StringTable names;     // Interned symbol names, kept apart from the persistent index
+};
 
-  Dwarf_Signed count;           // Aranges cache
-  Dwarf_Arange* aranges;        //   -- // --
+struct SymbolEntry
+{
+  Dwarf_Addr address;
+  Dwarf_Unsigned size;
+  const char* name;           // Interned by the unit
+  atomic_uintptr_t readable;  // Demangled name, computed on demand and interned as well
+};
 
-  struct SourceCache* sources;  // Source cache
+struct SymbolTable
+{
+  size_t count;                 // Functions sorted by address
+  struct SymbolEntry* entries;  //   -- // --
 };
 
-struct NameList
+struct DebugRequest
 {
-  char* data;
-  size_t size;
-  size_t length;
+  uintptr_t address;
+  size_t index;
+};
+
+struct DebugModule
+{
+  atomic_uintptr_t unit;    // struct DebugUnit*, resolved on demand
+  const char* name;         // NULL when the file is not accessible
+
+  dev_t device;             // Key of the unit
+  ino_t inode;              //   -- // --
+  size_t size;              //   -- // --
+  uint8_t identifier[64];   //   -- // --
+};
+
+struct DebugSegment
+{
+  uintptr_t start;
+  uintptr_t end;
+  uintptr_t base;
+  struct DebugModule* module;
+};
+
+struct SegmentList
+{
+  const char* name;               // Path of the main program
+  struct DebugArena* previous;    // Modules of the previous module map are reused when Build ID matches
+
+  unsigned long long adds;        // Counters of dl_iterate_phdr()
+  unsigned long long subs;        //   -- // --
+
+  struct DebugSegment* data;      // Segments refer to modules by number until the arena is built
+  size_t size;                    //   -- // --
+  size_t length;                  //   -- // --
+
+  struct DebugModule* modules;    // Modules own copies of their names until the arena is built
+  size_t capacity;                //   -- // --
+  size_t count;                   //   -- // --
+};
+
+struct DebugArena
+{
+  uintptr_t next;                 // Previous arenas waiting to be retired, protected by refresher
+  size_t size;                    // Size of the mapping
+
+  unsigned long long adds;        // Counters of dl_iterate_phdr() at the moment of snapshot
+  unsigned long long subs;        //   -- // --
+
+  size_t length;                  // Snapshot of loaded segments sorted by address
+  struct DebugSegment* segments;  //   -- // --
+
+  size_t count;                   // Loaded modules, names are interned by images
+  struct DebugModule* modules;    //   -- // --
+};
+
+struct DebugScratch
+{
+  atomic_flag busy;               // Scratch for GetDebugInformationBatch in async-signal-safe mode
+  struct DebugRequest requests[DEBUG_SCRATCH_SIZE];
+};
+
+struct DebugRetiree
+{
+  struct DebugRetiree* next;
+  unsigned int epoch;           // Epoch of unlinking, readers of previous epochs could still use the object
+  int type;                     // DEBUG_RETIRE_*
+  void* object;
+};
+
+struct DebugCandidate
+{
+  struct DebugUnit* unit;
+  struct DebugIndex* index;     // Index of the slot at the moment of collection
+  size_t number;                // Slot, SIZE_MAX for the whole unit
+  unsigned int stamp;
+};
+
+struct DebugLoader
+{
+  int generation;                // Loader is cancelled when the global generation changes
+  struct DebugModule* modules;   // Modules to load
+  size_t count;                  //   -- // --
+  atomic_size_t next;            // Position of the next module to take by a worker
+};
+
+struct DebugFrameRecord
+{
+  unsigned int version;         // Version of the frame cache the record belongs to
+  unsigned int flags;           // DEBUG_FRAME_*
+  uintptr_t address;            // Looked up address
+  const char* module;           // Module and its load base
+  uintptr_t base;               //   -- // --
+  const char* symbol;           // ELF symbol and its address, when DEBUG_FRAME_SYMBOL is set
+  uintptr_t start;              //   -- // --
+  size_t depth;                 // Length of the chain of inlined frames, 0 when unknown
+  struct DebugSourceInformation source;
+};
+
+struct DebugFrameSlot
+{
+  atomic_uint sequence;         // Odd while the record is written
+  struct DebugFrameRecord record;
+} __attribute__((aligned(DEBUG_LINE_SIZE)));
+
+struct DebugWriter
+{
+  char* buffer;                 // Text of a backtrace, always terminated
+  size_t size;                  //   -- // --
+  size_t length;                //   -- // --
+  size_t number;                // Number of the next line
+};
+
+struct DebugSnapshot
+{
+  struct SegmentList list;        // Segments refer to modules by number, modules keep resolved units between calls
+};
+
+struct DebugSymbolizer
+{
+  struct DebugModule** modules;   // Modules hit by requests
+  size_t count;                   //   -- // --
+  struct DebugRequest* requests;  // Requests sorted by address, taken by chunks
+  size_t length;                  //   -- // --
+  size_t chunk;                   //   -- // --
+  struct DebugSegment* segments;  // Segments of the snapshot sorted by address
+  size_t number;                  //   -- // --
+  struct DebugSourceInformation* results;
+  atomic_size_t next;             // Position of the next module or chunk to take by a worker
+  atomic_int result;
+};
+
+struct DebugReplica
+{
+  int handle;                     // |
+  Elf* module;                    // | Private instance of a worker, libdwarf is not thread-safe
+  Dwarf_Debug instance;           // |
+  struct SplitPackage package;    // Split units of the private instance
+  size_t weight;                  // Accounted by the budget, the unit could be reopened meanwhile
+  struct RangeList list;          // Ranges collected by the worker
+};
+
+struct DebugBuilder
+{
+  struct DebugUnit* unit;
+  struct DebugLoader* loader;
+  struct DebugIndex* index;       // Index built by workers, its slots are built next
+  Dwarf_Off* offsets;             // Compilation units
+  size_t count;                   //   -- // --
+  struct DebugReplica* replicas;  // Taken by workers one by one
+  size_t length;                  //   -- // --
+  atomic_size_t worker;           //   -- // --
+  atomic_size_t next;             // Position of the next unit or slot to take by a worker
+};
+
+struct DebugHelperSlot
+{
+  atomic_size_t sequence;       // Position in the ring the slot is ready for
+  atomic_uint state;            // DEBUG_SLOT_*, futex of the requester
+
+  uintptr_t address;            // Relative to the module, the location of the row in the answer
+  dev_t device;                 // Key of the module
+  ino_t inode;                  //   -- // --
+  size_t size;                  //   -- // --
+  uint8_t identifier[64];       //   -- // --
+  char name[DEBUG_HELPER_NAME_SIZE];
+
+  int result;                   // Answer of the helper
+  uint64_t line;                //   -- // --
+  uint64_t column;              //   -- // --
+  char path[DEBUG_HELPER_STRING_SIZE];
+  char function[DEBUG_HELPER_STRING_SIZE];
+};
+
+struct DebugHelperRing
+{
+  atomic_uint state;            // DEBUG_HELPER_*
+  atomic_uint counter;          // Futex of the helper, incremented by every request
+  atomic_size_t tail;           // Next position to claim by requesters
+  size_t head;                  // Next position to serve, owned by the helper
+  pid_t child;
+  struct DebugHelperSlot slots[DEBUG_HELPER_RING_SIZE];
 };
 
 static atomic_int state;
+static atomic_int generation;
+static unsigned int lineage;                // Incremented by every forked child
+static atomic_size_t progress[2];  // Loaded and scheduled modules of the last update
 static atomic_uintptr_t cache;
-static debuginfod_client* client;
+static atomic_uintptr_t arena;
+static struct StringTable images;           // Paths of modules of all module maps, protected by refresher
+static char directory[PATH_MAX];
+static pthread_mutex_t refresher = PTHREAD_MUTEX_INITIALIZER;
+static struct DebugScratch scratch = { .busy = ATOMIC_FLAG_INIT };
+
+static atomic_uint epoch;                   // Readers are counted by parity of epoch in shards
+static struct DebugReaders readers[DEBUG_SHARD_COUNT];
+static atomic_uint tick;                    // Clock of LRU, advanced by every eviction pass
+static atomic_size_t usage;                 // Estimated size of all built tables and loaded DWARF
+static atomic_size_t budget;                // Memory budget, 0 for unlimited
+static struct DebugRetiree* retirees;       // Evicted objects waiting for readers, protected by trimmer
+static struct DebugRetiree* reserve;        // Allocated before an object is unlinked, protected by trimmer
+static pthread_mutex_t trimmer = PTHREAD_MUTEX_INITIALIZER;
+
+static struct FileRegistry registry;       // Paths of all files ever resolved, protected by registrar
+static pthread_mutex_t registrar = PTHREAD_MUTEX_INITIALIZER;
+
+static struct DebugUnit* fetches;           // Queue of units waiting for debuginfod
+static int fetchers;                        // Running fetch threads
+static atomic_int closing;                  // Process is exiting, downloads have to be aborted
+static atomic_uint revision;                // Incremented when a fetch has brought debug information
+static pthread_mutex_t fetcher = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fetched  = PTHREAD_COND_INITIALIZER;
+
+static atomic_uint validity;                // Version of the frame cache, changed by unloading of modules and by eviction
+static struct DebugFrameSlot frames[1 << DEBUG_FRAME_ORDER];
+static atomic_long moment;                  // Period of the last check of the module map by the frame cache
+
+static atomic_uintptr_t helper;             // struct DebugHelperRing* shared with the helper process
+static pthread_mutex_t launcher = PTHREAD_MUTEX_INITIALIZER;
 
 // ELF helper
 
@@ -131,647 +628,6240 @@ static uint8_t* GetBuildID(Elf* image, size_t* size)
   return NULL;
 }
 
-// Load and cache
-
-static void ReleaseDebugUnitCache()
+static size_t GetDWARFWeight(Elf* image)
 {
-  Dwarf_Error error;
-  struct DebugUnit* unit;
-  struct DebugUnit* next;
-  struct SourceCache* source;
+  GElf_Shdr header;
+  Elf_Scn* section;
+  size_t weight;
+  size_t index;
+  char* name;
 
-  unit = (struct DebugUnit*)atomic_exchange_explicit(&cache, 0, memory_order_relaxed);
+  // libdwarf loads whole sections, so their sizes are a fair estimate of its memory
 
-  while (unit != NULL)
-  {
-    next = (struct DebugUnit*)unit->next;
+  weight  = 0;
+  section = NULL;
 
-    while (unit->sources != NULL)
+  if (elf_getshdrstrndx(image, &index) >= 0)
+  {
+    while (section = elf_nextscn(image, section))
     {
-      source        = unit->sources;
-      unit->sources = source->next;
-
-      dwarf_srclines_dealloc_b(source->context);
-      dwarf_dealloc(unit->instance, source->entry, DW_DLA_DIE);
-      free(source->list);
-      free(source);
+      if ((gelf_getshdr(section, &header) != NULL) &&
+          (name = elf_strptr(image, index, header.sh_name)) &&
+          (strncmp(name, ".debug_", 7) == 0))
+        weight += header.sh_size;
     }
+  }
 
-    if (unit->aranges != NULL)
-    {
-      while (unit->count > 0)
-      {
-        unit->count --;
-        dwarf_dealloc(unit->instance, unit->aranges[unit->count], DW_DLA_ARANGE);
-      }
+  return weight;
+}
 
-      dwarf_dealloc(unit->instance, unit->aranges, DW_DLA_LIST);
-    }
+static size_t GetModuleBuildID(struct dl_phdr_info* information, uint8_t* identifier, size_t size)
+{
+  const ElfW(Phdr)* header;
+  const ElfW(Phdr)* limit;
+  const ElfW(Nhdr)* note;
+  const uint8_t* boundary;
+  const uint8_t* name;
+  const uint8_t* data;
+  size_t alignment;
 
-#ifndef DW_LIBDWARF_VERSION
-    dwarf_finish(unit->instance, &error);
-#else
-    dwarf_finish(unit->instance);
-#endif
+  // Read Build ID from notes of the loaded image, the file on disk could be already replaced
 
-    elf_end(unit->module);
-    close(unit->handle);
+  header = information->dlpi_phdr;
+  limit  = information->dlpi_phdr + information->dlpi_phnum;
 
-    pthread_mutex_destroy(&unit->lock);
-    free(unit->name);
-    free(unit);
+  for ( ; header < limit; header ++)
+  {
+    if (header->p_type == PT_NOTE)
+    {
+      note      = (const ElfW(Nhdr)*)(information->dlpi_addr + header->p_vaddr);
+      boundary  = (const uint8_t*)note + header->p_memsz;
+      alignment = (header->p_align == 8) ? 8 : 4;
 
-    unit = next;
+      while ((const uint8_t*)(note + 1) <= boundary)
+      {
+        name = (const uint8_t*)(note + 1);
+        data = name + ((note->n_namesz + alignment - 1) & ~(alignment - 1));
+
+        if ((note->n_type   == NT_GNU_BUILD_ID) &&
+            (note->n_namesz == sizeof(ELF_NOTE_GNU)) &&
+            (note->n_descsz <= size) &&
+            (data + note->n_descsz <= boundary) &&
+            (memcmp(name, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0))
+        {
+          memcpy(identifier, data, note->n_descsz);
+          return note->n_descsz;
+        }
+
+        note = (const ElfW(Nhdr)*)(data + ((note->n_descsz + alignment - 1) & ~(alignment - 1)));
+      }
+    }
   }
-}
 
-static void __attribute__((constructor(103))) Initialize()
-{
-  atomic_init(&cache, 0);
-  elf_version(EV_CURRENT);
-  client = debuginfod_begin();
+  return 0;
 }
 
-static void __attribute__((destructor)) Finalize()
-{
-  ReleaseDebugUnitCache();
-  debuginfod_end(client);
-}
+// Interned strings
 
-static struct DebugUnit* GetDebugUnit(const char* name, debuginfod_client* client)
+static uint64_t GetStringHash(const char* string)
 {
-  struct DebugUnit* unit;
+  uint64_t hash;
 
-  int result;
-  size_t size;
-  struct stat status;
-  char path[PATH_MAX];
+  // FNV-1a
 
-  GElf_Shdr header;
-  Dwarf_Error error;
-  uint8_t* identifier;
+  for (hash = 14695981039346656037ULL; *string != '\0'; string ++)
+    hash = (hash ^ (uint8_t)*string) * 1099511628211ULL;
 
-  // Try to find a unit in the cache
+  return hash;
+}
 
-  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_relaxed);
-    (unit != NULL) && (strcmp(name, unit->name) != 0); unit = (struct DebugUnit*)unit->next);
+static const char* InternString(struct StringTable* table, const char* string)
+{
+  size_t size;
+  size_t index;
+  size_t number;
+  char** data;
 
-  // Create a new unit otherwise
+  // Open addressing, the table is modified under a lock of its owner only
 
-  if ((unit == NULL) &&
-      (unit       = (struct DebugUnit*)calloc(1, sizeof(struct DebugUnit))) &&
-      (unit->name = strdup(name)))
+  if (((table->count + 1) * 2 > table->size) &&
+      (data = (char**)calloc(table->size * 2 + 64, sizeof(char*))))
   {
-    pthread_mutex_init(&unit->lock, NULL);
-
-    // Try to load unit directly from the binary
-
-    unit->handle = open(name, O_RDONLY);
+    size = table->size * 2 + 64;
 
-    if ((unit->handle >= 0) &&
-        (unit->module  = elf_begin(unit->handle, ELF_C_READ, NULL)) &&
-        (GetELFSection(unit->module, ".debug_info", &header) != NULL))
+    for (number = 0; number < table->size; number ++)
     {
-      // Result does not matter
-#ifndef DW_LIBDWARF_VERSION
-      dwarf_elf_init(unit->module, DW_DLC_READ, NULL, NULL, &unit->instance, &error);
-#else
-      dwarf_init_b(unit->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &unit->instance, &error);
-#endif
-    }
-
-    // Try to load separated .debug file
-    // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
-
-    if ((unit->instance == NULL) &&
-        (unit->module   != NULL) &&
-        (identifier = GetBuildID(unit->module, &size)) &&
-        (size == 20) &&
-        (sprintf(path, "/usr/lib/debug/.build-id/%02x/%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x.debug",
-          identifier[ 0], identifier[ 1], identifier[ 2], identifier[ 3], identifier[ 4], identifier[ 5], identifier[ 6], identifier[ 7], identifier[ 8], identifier[ 9],
-          identifier[10], identifier[11], identifier[12], identifier[13], identifier[14], identifier[15], identifier[16], identifier[17], identifier[18], identifier[19]) > 0) &&
-        (stat(path, &status) == 0))
-    {
-      elf_end(unit->module);
-      close(unit->handle);
-
-      unit->handle = open(path, O_RDONLY);
-      unit->module = NULL;
-
-      if ((unit->handle >= 0) &&
-          (unit->module  = elf_begin(unit->handle, ELF_C_READ, NULL)))
+      if (table->data[number] != NULL)
       {
-        // Result does not matter
-#ifndef DW_LIBDWARF_VERSION
-        dwarf_elf_init(unit->module, DW_DLC_READ, NULL, NULL, &unit->instance, &error);
-#else
-        dwarf_init_b(unit->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &unit->instance, &error);
-#endif
+        for (index = GetStringHash(table->data[number]) % size; data[index] != NULL; index = (index + 1) % size);
+        data[index] = table->data[number];
       }
     }
 
-    // Try to load file from debuginfod
-    // https://sourceware.org/elfutils/Debuginfod.html
-
-    if ((unit->instance == NULL) &&
-        (unit->module   != NULL) &&
-        (client     != NULL) &&
-        (identifier != NULL) &&
-        ((result = debuginfod_find_debuginfo(client, identifier, size, NULL)) >= 0))
-    {
-      elf_end(unit->module);
-      close(unit->handle);
-
-      unit->handle = result;
-      unit->module = NULL;
-
-      if (unit->module = elf_begin(unit->handle, ELF_C_READ, NULL))
-      {
-        // Result does not matter
-#ifndef DW_LIBDWARF_VERSION
-        dwarf_elf_init(unit->module, DW_DLC_READ, NULL, NULL, &unit->instance, &error);
-#else
-        dwarf_init_b(unit->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &unit->instance, &error);
-#endif
-      }
-    }
+    free(table->data);
+    table->data = data;
+    table->size = size;
+  }
 
-    // Clean if failed
+  if (table->count + 1 >= table->size)
+  {
+    // Out of memory, at least one slot has to stay empty
+    return NULL;
+  }
 
-    if (unit->instance == NULL)
+  for (index = GetStringHash(string) % table->size; table->data[index] != NULL; index = (index + 1) % table->size)
+  {
+    if (strcmp(table->data[index], string) == 0)
     {
-      elf_end(unit->module);
-      close(unit->handle);
-
-      unit->module = NULL;
-      unit->handle = -1;
+      // String is already interned
+      return table->data[index];
     }
+  }
 
-    // Add unit to the cache
-
-    do { unit->next = atomic_load_explicit(&cache, memory_order_relaxed); }
-    while (!atomic_compare_exchange_strong_explicit(&cache, &unit->next, (uintptr_t)unit, memory_order_release, memory_order_relaxed));
+  if (table->data[index] = strdup(string))
+  {
+    // Strings are never moved
+    table->count ++;
   }
 
-  return unit;
+  return table->data[index];
+}
+
+static const char* InternUnitString(struct DebugUnit* unit, const char* string)
+{
+  const char* result;
+
+  pthread_mutex_lock(&unit->interner);
+  result = InternString(&unit->strings, string);
+  pthread_mutex_unlock(&unit->interner);
+
+  return result;
+}
+
+static uint32_t GetStringNumber(struct StringTable* table, const char* string)
+{
+  uint32_t number;
+
+  // Interned strings are identified by position in the table, the string has to be interned before
+
+  for (number = GetStringHash(string) % table->size;
+    table->data[number] != string; number = (number + 1) % table->size);
+
+  return number;
+}
+
+static int GrowFileRegistry()
+{
+  size_t size;
+  size_t index;
+  size_t number;
+  uint32_t* slots;
+  const char** paths;
+
+  // Called with registrar held, slots keep identifiers of paths, both arrays grow together
+
+  size  = registry.size * 2 + 256;
+  slots = (uint32_t*)calloc(size, sizeof(uint32_t));
+  paths = (const char**)realloc(registry.paths, (size / 2 + 1) * sizeof(char*));
+
+  if ((slots == NULL) ||
+      (paths == NULL))
+  {
+    registry.paths = (paths != NULL) ? paths : registry.paths;
+    free(slots);
+    return 0;
+  }
+
+  for (number = 1; number < registry.count; number ++)
+  {
+    for (index = GetStringHash(paths[number]) % size; slots[index] != 0; index = (index + 1) % size);
+    slots[index] = number;
+  }
+
+  free(registry.slots);
+
+  registry.size     = size;
+  registry.slots    = slots;
+  registry.paths    = paths;
+  registry.capacity = size / 2 + 1;
+  registry.count    = (registry.count > 0) ? registry.count : 1;
+  return 1;
+}
+
+static uint32_t* RegisterDebugFiles(const char** files, size_t number)
+{
+  size_t index;
+  size_t count;
+  char* path;
+  uint32_t* identifiers;
+
+  // The same path gets the same identifier in all units, paths of units could point into a mapping
+  // which is released by eviction, so the registry keeps own copies
+
+  if ((files == NULL) ||
+      (identifiers = (uint32_t*)calloc(number + 1, sizeof(uint32_t))) == NULL)
+  {
+    // Out of memory, files are unknown
+    return NULL;
+  }
+
+  pthread_mutex_lock(&registrar);
+
+  for (count = 0; count < number; count ++)
+  {
+    if ((files[count] == NULL) ||
+        (registry.count + 1 >= registry.capacity) &&
+        (GrowFileRegistry() == 0))
+    {
+      // Unknown file or out of memory
+      continue;
+    }
+
+    for (index = GetStringHash(files[count]) % registry.size;
+      (registry.slots[index] != 0) && (strcmp(registry.paths[registry.slots[index]], files[count]) != 0);
+      index = (index + 1) % registry.size);
+
+    if ((registry.slots[index] == 0) &&
+        (path = strdup(files[count])))
+    {
+      registry.paths[registry.count] = path;
+      registry.slots[index]          = registry.count ++;
+    }
+
+    identifiers[count] = registry.slots[index];
+  }
+
+  pthread_mutex_unlock(&registrar);
+
+  return identifiers;
+}
+
+// Instrumentation
+
+static uint64_t GetDebugTime()
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static int GetDebugShard()
+{
+  int number;
+
+  // CPU is a cheap hint served by rseq or vDSO (async-signal-safe), threads of the same hot module
+  // write to their own cache lines, a thread migrated meanwhile only shares a line for a moment
+
+  number = sched_getcpu();
+  return (number > 0) ? (number & (DEBUG_SHARD_COUNT - 1)) : 0;
+}
+
+static void CountDebugEvent(struct DebugUnit* unit, int counter, uint64_t value)
+{
+  atomic_fetch_add_explicit(unit->shards[GetDebugShard()].counters + counter, value, memory_order_relaxed);
+}
+
+static void CountDebugTime(struct DebugUnit* unit, int tier, uint64_t start)
+{
+  atomic_fetch_add_explicit(unit->shards[GetDebugShard()].counters + DEBUG_COUNTER_TIMES + tier, GetDebugTime() - start, memory_order_relaxed);
+}
+
+static void ReadDebugCounters(struct DebugUnit* unit, struct DebugCounters* counters)
+{
+  int tier;
+  int number;
+  atomic_uint_fast64_t* values;
+
+  // Shards of all units are summed up
+
+  for (number = 0; number < DEBUG_SHARD_COUNT; number ++)
+  {
+    values = unit->shards[number].counters;
+
+    counters->hits        += atomic_load_explicit(values + DEBUG_COUNTER_HITS,        memory_order_relaxed);
+    counters->misses      += atomic_load_explicit(values + DEBUG_COUNTER_MISSES,      memory_order_relaxed);
+    counters->evictions   += atomic_load_explicit(values + DEBUG_COUNTER_EVICTIONS,   memory_order_relaxed);
+    counters->aranges     += atomic_load_explicit(values + DEBUG_COUNTER_ARANGES,     memory_order_relaxed);
+    counters->scans       += atomic_load_explicit(values + DEBUG_COUNTER_SCANS,       memory_order_relaxed);
+    counters->walks       += atomic_load_explicit(values + DEBUG_COUNTER_WALKS,       memory_order_relaxed);
+    counters->contentions += atomic_load_explicit(values + DEBUG_COUNTER_CONTENTIONS, memory_order_relaxed);
+    counters->fetches     += atomic_load_explicit(values + DEBUG_COUNTER_FETCHES,     memory_order_relaxed);
+    counters->failures    += atomic_load_explicit(values + DEBUG_COUNTER_FAILURES,    memory_order_relaxed);
+    counters->negatives   += atomic_load_explicit(values + DEBUG_COUNTER_NEGATIVES,   memory_order_relaxed);
+
+    for (tier = 0; tier < DEBUG_TIER_COUNT; tier ++)
+      counters->times[tier] += atomic_load_explicit(values + DEBUG_COUNTER_TIMES + tier, memory_order_relaxed);
+  }
+}
+
+// Negative cache
+
+static int CheckMissCache(struct DebugUnit* unit, Dwarf_Addr address)
+{
+  // Fibonacci hashing, value 0 is reserved for an empty slot
+
+  if (atomic_load_explicit(unit->misses + ((address * 0x9e3779b97f4a7c15ULL) >> (64 - DEBUG_MISS_ORDER)), memory_order_relaxed) != address + 1)
+    return 0;
+
+  CountDebugEvent(unit, DEBUG_COUNTER_NEGATIVES, 1);
+  return 1;
+}
+
+static void UpdateMissCache(struct DebugUnit* unit, Dwarf_Addr address)
+{
+  atomic_store_explicit(unit->misses + ((address * 0x9e3779b97f4a7c15ULL) >> (64 - DEBUG_MISS_ORDER)), address + 1, memory_order_relaxed);
+}
+
+static void ClearMissCache(struct DebugUnit* unit)
+{
+  size_t number;
+
+  // Called when the index or a table is published, an address missed by old data might be resolved by new one
+
+  for (number = 0; number < (1 << DEBUG_MISS_ORDER); number ++)
+    atomic_store_explicit(unit->misses + number, 0, memory_order_relaxed);
+}
+
+// Load and cache
+
+static void ReleaseSourceTable(struct SourceTable* source, int mapped)
+{
+  if (source != NULL)
+  {
+    if (mapped == 0)
+    {
+      free(source->frames);
+      free(source->blocks);
+      free(source->rows);
+    }
+
+    free(source->identifiers);
+    free(source->names);
+    free(source->files);
+    free(source);
+  }
+}
+
+static void ReleaseDebugIndex(struct DebugIndex* index)
+{
+  if (index != NULL)
+  {
+    while (index->count > 0)
+    {
+      index->count --;
+      ReleaseSourceTable((struct SourceTable*)atomic_load_explicit(&index->slots[index->count].table, memory_order_relaxed), index->mapping != NULL);
+    }
+
+    if (index->mapping != NULL)
+      munmap(index->mapping, index->size);
+    else
+      free(index->ranges);
+
+    free(index->slots);
+    free(index);
+  }
+}
+
+static void ReleaseSymbolTable(struct SymbolTable* symbols)
+{
+  if (symbols != NULL)
+  {
+    // Names are interned by the unit
+    free(symbols->entries);
+    free(symbols);
+  }
+}
+
+static void ReleaseStringTable(struct StringTable* table)
+{
+  while (table->size > 0)
+  {
+    table->size --;
+    free(table->data[table->size]);
+  }
+
+  free(table->data);
+}
+
+static void CloseSplitPackage(struct SplitPackage* package)
+{
+  // Package is tied to the instance, so it is closed before
+
+  if (package->instance != NULL)
+  {
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_finish(package->instance, NULL);
+#else
+    dwarf_finish(package->instance);
+#endif
+    elf_end(package->module);
+    close(package->handle);
+  }
+
+  memset(package, 0, sizeof(struct SplitPackage));
+}
+
+static void ReleaseDebugUnitCache()
+{
+  Dwarf_Error error;
+  struct DebugUnit* unit;
+  struct DebugUnit* next;
+
+  unit = (struct DebugUnit*)atomic_exchange_explicit(&cache, 0, memory_order_relaxed);
+
+  while (unit != NULL)
+  {
+    next = (struct DebugUnit*)unit->next;
+
+    ReleaseDebugIndex((struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_relaxed));
+    ReleaseSymbolTable((struct SymbolTable*)atomic_load_explicit(&unit->symbols, memory_order_relaxed));
+    ReleaseStringTable(&unit->strings);
+    ReleaseStringTable(&unit->names);
+    CloseSplitPackage(&unit->package);
+
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_finish(unit->instance, &error);
+#else
+    dwarf_finish(unit->instance);
+#endif
+
+    elf_end(unit->module);
+    close(unit->handle);
+
+    pthread_mutex_destroy(&unit->lock);
+    pthread_mutex_destroy(&unit->interner);
+    free(unit->debug);
+    free(unit->name);
+    free(unit);
+
+    unit = next;
+  }
+}
+
+static void ReleaseDebugArena()
+{
+  struct DebugArena* current;
+  struct DebugArena* next;
+
+  current = (struct DebugArena*)atomic_exchange_explicit(&arena, 0, memory_order_relaxed);
+
+  while (current != NULL)
+  {
+    next = (struct DebugArena*)current->next;
+    munmap(current, current->size);
+    current = next;
+  }
+}
+
+static void ReleaseRetiredObjects(unsigned int boundary, int force)
+{
+  struct DebugRetiree** pointer;
+  struct DebugRetiree* retiree;
+
+  // Objects retired before the boundary epoch are not used by anybody
+
+  pointer = &retirees;
+
+  while (retiree = *pointer)
+  {
+    if ((force == 0) &&
+        ((int)(boundary - retiree->epoch) <= 0))
+    {
+      pointer = &retiree->next;
+      continue;
+    }
+
+    switch (retiree->type)
+    {
+      case DEBUG_RETIRE_SOURCE:   ReleaseSourceTable((struct SourceTable*)retiree->object, 0);  break;
+      case DEBUG_RETIRE_INDEX:    ReleaseDebugIndex((struct DebugIndex*)retiree->object);       break;
+      case DEBUG_RETIRE_SYMBOLS:  ReleaseSymbolTable((struct SymbolTable*)retiree->object);     break;
+      case DEBUG_RETIRE_ARENA:    munmap(retiree->object, ((struct DebugArena*)retiree->object)->size);  break;
+    }
+
+    *pointer = retiree->next;
+    free(retiree);
+  }
+}
+
+static void __attribute__((constructor(103))) Initialize()
+{
+  const char* path;
+
+  // https://specifications.freedesktop.org/basedir-spec/latest/
+
+  if (path = getenv("XDG_CACHE_HOME"))
+    snprintf(directory, PATH_MAX, "%s/DebugDecoder", path);
+  else if (path = getenv("HOME"))
+    snprintf(directory, PATH_MAX, "%s/.cache/DebugDecoder", path);
+
+  atomic_init(&cache, 0);
+  atomic_init(&arena, 0);
+  elf_version(EV_CURRENT);
+
+#if defined(DW_LIBDWARF_VERSION_MAJOR) && ((DW_LIBDWARF_VERSION_MAJOR > 0) || (DW_LIBDWARF_VERSION_MINOR >= 9))
+  // Sections are mapped instead of copied, pages of large packages are shared and could be dropped by the kernel,
+  // libdwarf has no preference per instance, so it applies to instances opened by the host as well
+  dwarf_set_load_preference(Dwarf_Alloc_Mmap);
+#endif
+}
+
+static void __attribute__((destructor)) Finalize()
+{
+  // Running downloads are aborted, fetchers use units until they leave
+
+  atomic_store_explicit(&closing, 1, memory_order_relaxed);
+  pthread_mutex_lock(&fetcher);
+
+  while (fetchers > 0)
+    pthread_cond_wait(&fetched, &fetcher);
+
+  pthread_mutex_unlock(&fetcher);
+
+  ReleaseRetiredObjects(0, 1);
+  free(reserve);
+  ReleaseDebugArena();
+  ReleaseDebugUnitCache();
+  ReleaseStringTable(&images);
+
+  while (registry.count > 1)
+  {
+    registry.count --;
+    free((char*)registry.paths[registry.count]);
+  }
+
+  free(registry.paths);
+  free(registry.slots);
+}
+
+// Reclamation
+
+static size_t GetSourceTableWeight(struct SourceTable* source, int mapped)
+{
+  // Rows, blocks and frames of a persistent index belong to the mapping
+
+  return
+    sizeof(struct SourceTable) +
+    (source->number + 1) * (sizeof(char*) + sizeof(uint32_t)) +
+    (source->total  + 1) * sizeof(char*) +
+    (mapped == 0) * (
+      source->length * sizeof(struct SourceRow)     +
+      (source->count + 1) * sizeof(struct SourceBlock) +
+      source->span * sizeof(struct SourceFrame));
+}
+
+static size_t GetDebugIndexWeight(struct DebugIndex* index)
+{
+  size_t size;
+  size_t number;
+  struct SourceTable* source;
+
+  size  = sizeof(struct DebugIndex) + (index->count + 1) * sizeof(struct SourceSlot);
+  size += (index->mapping == NULL) * index->length * sizeof(struct DebugRange);
+
+  for (number = 0; number < index->count; number ++)
+  {
+    if (source = (struct SourceTable*)atomic_load_explicit(&index->slots[number].table, memory_order_relaxed))
+    {
+      // Tables are retired together with the index
+      size += GetSourceTableWeight(source, index->mapping != NULL);
+    }
+  }
+
+  return size;
+}
+
+static size_t GetSymbolTableWeight(struct SymbolTable* symbols)
+{
+  return sizeof(struct SymbolTable) + symbols->count * sizeof(struct SymbolEntry);
+}
+
+static unsigned int EnterDebugCache()
+{
+  int shard;
+  unsigned int current;
+
+  // Reader is registered in the epoch which is still current after registration,
+  // so a reclaimer either waits for it or it never sees unlinked objects (async-signal-safe),
+  // the token keeps the shard, so the reader leaves the same count even when migrated to another CPU
+
+  shard = GetDebugShard();
+
+  while (1)
+  {
+    current = atomic_load(&epoch);
+    atomic_fetch_add(readers[shard].counts + (current & 1), 1);
+
+    if (atomic_load(&epoch) == current)
+      return (shard << 1) | (current & 1);
+
+    atomic_fetch_sub(readers[shard].counts + (current & 1), 1);
+  }
+}
+
+static void LeaveDebugCache(unsigned int token)
+{
+  atomic_fetch_sub_explicit(readers[token >> 1].counts + (token & 1), 1, memory_order_release);
+}
+
+static int CountDebugReaders(unsigned int parity)
+{
+  int count;
+  int number;
+
+  // Every reader stays in one shard, so a shard read after its reader has come means the reader has come after the check
+
+  count = 0;
+
+  for (number = 0; number < DEBUG_SHARD_COUNT; number ++)
+    count += atomic_load(readers[number].counts + parity);
+
+  return count;
+}
+
+static void TouchDebugStamp(atomic_uint* stamp)
+{
+  unsigned int current;
+
+  // Stamp is written once per tick, so hot objects don't bounce cache lines
+
+  current = atomic_load_explicit(&tick, memory_order_relaxed);
+
+  if (atomic_load_explicit(stamp, memory_order_relaxed) != current)
+    atomic_store_explicit(stamp, current, memory_order_relaxed);
+}
+
+static int ReserveDebugRetiree()
+{
+  // Called with trimmer held, an object is unlinked only when it could be retired,
+  // so it stays in the cache instead of leaking when memory is exhausted
+
+  if (reserve == NULL)
+    reserve = (struct DebugRetiree*)malloc(sizeof(struct DebugRetiree));
+
+  return reserve != NULL;
+}
+
+static void RetireDebugObject(int type, void* object, size_t weight)
+{
+  struct DebugRetiree* retiree;
+
+  // Called with trimmer held after ReserveDebugRetiree(), the object is already unlinked, frames resolved by it are dropped
+
+  atomic_fetch_sub_explicit(&usage, weight, memory_order_relaxed);
+  atomic_fetch_add_explicit(&validity, 1, memory_order_release);
+
+  retiree         = reserve;
+  reserve         = NULL;
+  retiree->type   = type;
+  retiree->object = object;
+  retiree->epoch  = atomic_load(&epoch);
+  retiree->next   = retirees;
+  retirees        = retiree;
+}
+
+static void ReclaimDebugCache()
+{
+  int number;
+  unsigned int current;
+
+  // Called with trimmer held, epoch is advanced only when readers of the previous one have left,
+  // two attempts are enough to free everything when nobody reads
+
+  for (number = 0; number < 2; number ++)
+  {
+    current = atomic_load(&epoch);
+
+    if (CountDebugReaders((current + 1) & 1) != 0)
+      break;
+
+    atomic_store(&epoch, current + 1);
+    ReleaseRetiredObjects(current, 0);
+  }
+}
+
+static void ReleaseDebugInstance(struct DebugUnit* unit)
+{
+  // Called with lock of the unit held
+
+  CloseSplitPackage(&unit->package);
+
+  if (unit->instance != NULL)
+  {
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_finish(unit->instance, NULL);
+#else
+    dwarf_finish(unit->instance);
+#endif
+    unit->instance = NULL;
+  }
+
+  if (unit->module != NULL)
+  {
+    elf_end(unit->module);
+    unit->module = NULL;
+  }
+
+  if (unit->handle >= 0)
+  {
+    close(unit->handle);
+    unit->handle = -1;
+  }
+
+  atomic_fetch_sub_explicit(&usage, unit->weight, memory_order_relaxed);
+  unit->weight = 0;
+}
+
+static void EvictDebugUnit(struct DebugUnit* unit)
+{
+  struct DebugIndex* index;
+  struct SymbolTable* symbols;
+
+  // Called with trimmer and lock of the unit held, the shell of unit and its interned strings are kept
+
+  if (ReserveDebugRetiree() == 0)
+  {
+    // Out of memory, the unit stays as is
+    return;
+  }
+
+  if (index = (struct DebugIndex*)atomic_exchange_explicit(&unit->index, 0, memory_order_acq_rel))
+    RetireDebugObject(DEBUG_RETIRE_INDEX, index, GetDebugIndexWeight(index));
+
+  if ((ReserveDebugRetiree() != 0) &&
+      (symbols = (struct SymbolTable*)atomic_exchange_explicit(&unit->symbols, 0, memory_order_acq_rel)))
+    RetireDebugObject(DEBUG_RETIRE_SYMBOLS, symbols, GetSymbolTableWeight(symbols));
+
+  if ((index          != NULL) ||
+      (unit->instance != NULL))
+  {
+    // Next lookup reopens the module
+    atomic_store_explicit(&unit->evicted, 1, memory_order_relaxed);
+  }
+
+  ReleaseDebugInstance(unit);
+}
+
+// Persistent index
+
+static int FormatDebugCachePath(struct DebugUnit* unit, char* path, const char* suffix)
+{
+  char* pointer;
+  size_t number;
+
+  if ((unit->size == 0) ||
+      (*directory == '\0') ||
+      (strlen(directory) + unit->size * 2 + strlen(suffix) + 2 > PATH_MAX))
+  {
+    // Persistent index is disabled or not applicable
+    return 0;
+  }
+
+  pointer = path + sprintf(path, "%s/", directory);
+
+  for (number = 0; number < unit->size; number ++)
+    pointer += sprintf(pointer, "%02x", unit->identifier[number]);
+
+  strcpy(pointer, suffix);
+  return 1;
+}
+
+static int MakeDirectory(const char* path)
+{
+  char buffer[PATH_MAX];
+  char* pointer;
+
+  // Make all directories of the path, the last component is a file name
+
+  strcpy(buffer, path);
+
+  for (pointer = buffer + 1; pointer = strchr(pointer, '/'); pointer ++)
+  {
+    *pointer = '\0';
+
+    if ((mkdir(buffer, 0755) != 0) &&
+        (errno != EEXIST))
+    {
+      // Directory could not be created
+      return 0;
+    }
+
+    *pointer = '/';
+  }
+
+  return 1;
+}
+
+static int CheckDebugCacheSection(size_t size, uint64_t offset, uint64_t count, size_t length)
+{
+  return
+    (offset <= size) &&
+    (offset % sizeof(uint64_t) == 0) &&
+    (count  <= (size - offset) / length);
+}
+
+static const char** LoadDebugCacheStrings(struct DebugUnit* unit, uint8_t* mapping, size_t size, struct DebugCacheHeader* header, uint64_t offset, uint64_t count)
+{
+  size_t number;
+  uint32_t* list;
+  uint64_t* strings;
+  const char** table;
+  const char* string;
+
+  // Called with interner of the unit held, strings are interned by the unit,
+  // so paths and names handed out stay valid when the mapping is released by eviction
+
+  list    = (uint32_t*)(mapping + offset);
+  strings = (uint64_t*)(mapping + header->strings);
+
+  if (table = (const char**)calloc(count + 1, sizeof(char*)))
+  {
+    for (number = 0; number < count; number ++)
+    {
+      string = NULL;
+
+      if ((list[number] < header->number) &&
+          (strings[list[number]] != 0)    &&
+          (strings[list[number]] <  size))
+        string = InternString(&unit->strings, (const char*)mapping + strings[list[number]]);
+
+      table[number] = (string != NULL) ? string : "";
+    }
+  }
+
+  return table;
+}
+
+static int CheckDebugCacheTable(struct SourceTable* source)
+{
+  size_t last;
+  size_t number;
+  struct SourceBlock* block;
+
+  // Indexes of a mapped table are checked once, so lookups trust them like the ones of a built table
+
+  for (number = 1; number <= source->count; number ++)
+  {
+    block = source->blocks + number;
+    last  = (size_t)block->number * SOURCE_BLOCK_SIZE + SOURCE_BLOCK_SIZE;
+    last  = (last < source->length) ? last : source->length;
+
+    if ((block->number >= source->count) ||
+        (source->rows[last - 1].offset != block->offset))
+    {
+      // The walk over rows of the block has to stop at its last row
+      return 0;
+    }
+  }
+
+  for (number = 0; number < source->span; number ++)
+  {
+    if ((source->frames[number].parent != UINT32_MAX) &&
+        (source->frames[number].parent >= number))
+    {
+      // Enclosing frame always goes before
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static struct DebugIndex* MapDebugIndex(struct DebugUnit* unit, int handle)
+{
+  size_t size;
+  uint8_t* mapping;
+  struct stat status;
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct SourceTable* source;
+  struct DebugCacheTable* table;
+  struct DebugCacheHeader* header;
+
+  // Called with interner of the unit held, the handle is always closed, the mapping keeps the file
+
+  mapping = MAP_FAILED;
+
+  if ((fstat(handle, &status) == 0) &&
+      (status.st_size >= (off_t)sizeof(struct DebugCacheHeader)))
+  {
+    // Pages of the read-only mapping are shared by all processes
+    size    = status.st_size;
+    mapping = (uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, handle, 0);
+  }
+
+  close(handle);
+
+  if (mapping == MAP_FAILED)
+  {
+    // File is broken
+    return NULL;
+  }
+
+  header = (struct DebugCacheHeader*)mapping;
+
+  if ((header->magic   != DEBUG_CACHE_MAGIC)   ||
+      (header->version != DEBUG_CACHE_VERSION) ||
+      (header->width   != sizeof(void*))       ||
+      (header->size    != unit->size)          ||
+      (memcmp(header->identifier, unit->identifier, unit->size) != 0) ||
+      (mapping[size - 1] != '\0') ||
+      (CheckDebugCacheSection(size, header->ranges,  header->length, sizeof(struct DebugRange))      == 0) ||
+      (CheckDebugCacheSection(size, header->tables,  header->count,  sizeof(struct DebugCacheTable)) == 0) ||
+      (CheckDebugCacheSection(size, header->strings, header->number, sizeof(uint64_t))               == 0) ||
+      (index = (struct DebugIndex*)calloc(1, sizeof(struct DebugIndex))) == NULL)
+  {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  index->mapping = mapping;
+  index->size    = size;
+  index->length  = header->length;
+  index->ranges  = (struct DebugRange*)(mapping + header->ranges);
+  index->slots   = (struct SourceSlot*)calloc(header->count + 1, sizeof(struct SourceSlot));
+  table          = (struct DebugCacheTable*)(mapping + header->tables);
+
+  for (range = index->ranges; range < index->ranges + index->length; range ++)
+  {
+    if (range->number >= header->count)
+    {
+      // Reference to a missing table, the file is rejected and rebuilt
+      ReleaseDebugIndex(index);
+      return NULL;
+    }
+  }
+
+  while ((index->slots != NULL) &&
+         (index->count < header->count))
+  {
+    if ((CheckDebugCacheSection(size, table->rows,   table->length, sizeof(struct SourceRow))   == 0) ||
+        (CheckDebugCacheSection(size, table->blocks, table->count + 1, sizeof(struct SourceBlock)) == 0) ||
+        (CheckDebugCacheSection(size, table->files,  table->number, sizeof(uint32_t))           == 0) ||
+        (CheckDebugCacheSection(size, table->frames, table->span,   sizeof(struct SourceFrame)) == 0) ||
+        (CheckDebugCacheSection(size, table->names,  table->total,  sizeof(uint32_t))           == 0) ||
+        (table->count != (table->length + SOURCE_BLOCK_SIZE - 1) / SOURCE_BLOCK_SIZE) ||
+        (source = (struct SourceTable*)calloc(1, sizeof(struct SourceTable))) == NULL)
+    {
+      // Table is broken, the rest of slots stay empty
+      break;
+    }
+
+    source->offset = table->offset;
+    source->length = table->length;
+    source->rows   = (struct SourceRow*)(mapping + table->rows);
+    source->count  = table->count;
+    source->blocks = (struct SourceBlock*)(mapping + table->blocks);
+    source->files  = LoadDebugCacheStrings(unit, mapping, size, header, table->files, table->number);
+    source->number = (source->files != NULL) ? table->number : 0;
+    source->identifiers = RegisterDebugFiles(source->files, source->number);
+    source->span   = table->span;
+    source->frames = (struct SourceFrame*)(mapping + table->frames);
+    source->names  = LoadDebugCacheStrings(unit, mapping, size, header, table->names, table->total);
+    source->total  = (source->names != NULL) ? table->total : 0;
+
+    if (CheckDebugCacheTable(source) == 0)
+    {
+      // Table is broken, the file is rejected and rebuilt
+      ReleaseSourceTable(source, 1);
+      break;
+    }
+
+    index->slots[index->count].offset = table->offset;
+    atomic_init(&index->slots[index->count].table, (uintptr_t)source);
+    index->count ++;
+    table ++;
+  }
+
+  if ((index->slots == NULL) ||
+      (index->count != header->count))
+  {
+    ReleaseDebugIndex(index);
+    return NULL;
+  }
+
+  return index;
+}
+
+static int LoadDebugIndex(struct DebugUnit* unit)
+{
+  int handle;
+  char path[PATH_MAX];
+  struct DebugIndex* index;
+
+  if ((FormatDebugCachePath(unit, path, ".index") == 0) ||
+      ((handle = open(path, O_RDONLY)) < 0))
+  {
+    // Index has not been stored yet
+    return 0;
+  }
+
+  pthread_mutex_lock(&unit->interner);
+  index = MapDebugIndex(unit, handle);
+  pthread_mutex_unlock(&unit->interner);
+
+  if (index == NULL)
+  {
+    // Index is broken
+    return 0;
+  }
+
+  atomic_fetch_add_explicit(&usage, GetDebugIndexWeight(index), memory_order_relaxed);
+  atomic_store_explicit(&unit->index, (uintptr_t)index, memory_order_release);
+  ClearMissCache(unit);
+  return 1;
+}
+
+static void WriteDebugCache(FILE* file, const void* data, size_t size, uint64_t* offset)
+{
+  static const uint8_t padding[sizeof(uint64_t)] = { 0 };
+  size_t length;
+
+  // Keep every section aligned to 8 bytes
+
+  *offset = ftell(file);
+  length  = (sizeof(uint64_t) - size % sizeof(uint64_t)) % sizeof(uint64_t);
+
+  if (data != NULL)
+  {
+    fwrite(data, 1, size, file);
+    size = 0;
+  }
+
+  while (size > 0)
+  {
+    // Table without lines has no blocks, zeros keep the layout
+    fputc(0, file);
+    size --;
+  }
+
+  fwrite(padding, 1, length, file);
+}
+
+static int WriteDebugIndex(struct DebugUnit* unit, struct DebugIndex* index, FILE* file)
+{
+  size_t size;
+  size_t number;
+  uint64_t offset;
+  uint32_t* files;
+  uint32_t* names;
+  uint64_t* strings;
+  struct SourceTable* source;
+  struct DebugCacheTable* tables;
+  struct DebugCacheHeader header;
+
+  // All tables of the index have to be built before, called with interner of the unit held
+
+  tables  = (struct DebugCacheTable*)calloc(index->count + 1, sizeof(struct DebugCacheTable));
+  strings = (uint64_t*)calloc(unit->strings.size + 1, sizeof(uint64_t));
+
+  if ((tables  == NULL) ||
+      (strings == NULL))
+  {
+    free(strings);
+    free(tables);
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(struct DebugCacheHeader));
+
+  header.magic   = DEBUG_CACHE_MAGIC;
+  header.version = DEBUG_CACHE_VERSION;
+  header.width   = sizeof(void*);
+  header.size    = unit->size;
+  header.length  = index->length;
+  header.count   = index->count;
+  header.number  = unit->strings.size;
+
+  memcpy(header.identifier, unit->identifier, unit->size);
+
+  // Header and directories are written twice, the second time with actual offsets
+
+  WriteDebugCache(file, &header, sizeof(struct DebugCacheHeader), &offset);
+  WriteDebugCache(file, index->ranges, index->length * sizeof(struct DebugRange), &header.ranges);
+  WriteDebugCache(file, tables, index->count * sizeof(struct DebugCacheTable), &header.tables);
+
+  for (number = 0; number < index->count; number ++)
+  {
+    source = (struct SourceTable*)atomic_load_explicit(&index->slots[number].table, memory_order_acquire);
+
+    tables[number].offset = index->slots[number].offset;
+
+    files = NULL;
+    names = NULL;
+
+    if ((source != NULL) &&
+        (files   = (uint32_t*)calloc(source->number + 1, sizeof(uint32_t))) &&
+        (names   = (uint32_t*)calloc(source->total  + 1, sizeof(uint32_t))))
+    {
+      for (size = 0; size < source->number; size ++)
+        files[size] = GetStringNumber(&unit->strings, source->files[size]);
+
+      for (size = 0; size < source->total; size ++)
+        names[size] = GetStringNumber(&unit->strings, source->names[size]);
+
+      tables[number].length = source->length;
+      tables[number].count  = source->count;
+      tables[number].number = source->number;
+      tables[number].span   = source->span;
+      tables[number].total  = source->total;
+
+      WriteDebugCache(file, source->rows, source->length * sizeof(struct SourceRow), &tables[number].rows);
+      WriteDebugCache(file, source->blocks, (source->count + 1) * sizeof(struct SourceBlock), &tables[number].blocks);
+      WriteDebugCache(file, files, source->number * sizeof(uint32_t), &tables[number].files);
+      WriteDebugCache(file, source->frames, source->span * sizeof(struct SourceFrame), &tables[number].frames);
+      WriteDebugCache(file, names, source->total * sizeof(uint32_t), &tables[number].names);
+    }
+
+    free(names);
+    free(files);
+  }
+
+  WriteDebugCache(file, strings, unit->strings.size * sizeof(uint64_t), &header.strings);
+
+  for (number = 0; number < unit->strings.size; number ++)
+  {
+    if (unit->strings.data[number] != NULL)
+    {
+      // Include the terminating zero
+      WriteDebugCache(file, unit->strings.data[number], strlen(unit->strings.data[number]) + 1, strings + number);
+    }
+  }
+
+  // The file always ends with zero, so no string could run out of the mapping
+  WriteDebugCache(file, strings + unit->strings.size, sizeof(uint64_t), &offset);
+
+  fseek(file, header.strings, SEEK_SET);
+  fwrite(strings, sizeof(uint64_t), unit->strings.size, file);
+  fseek(file, header.tables, SEEK_SET);
+  fwrite(tables, sizeof(struct DebugCacheTable), index->count, file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(struct DebugCacheHeader), 1, file);
+
+  free(strings);
+  free(tables);
+
+  return ferror(file) == 0;
+}
+
+static void StoreDebugIndex(struct DebugUnit* unit, struct DebugIndex* index)
+{
+  int result;
+  int handle;
+  FILE* file;
+  char path1[PATH_MAX];
+  char path2[PATH_MAX];
+
+  if ((index->mapping != NULL) ||
+      (FormatDebugCachePath(unit, path1, ".index")        == 0) ||
+      (FormatDebugCachePath(unit, path2, ".index.XXXXXX") == 0))
+  {
+    // Index is already persistent or caching is disabled
+    return;
+  }
+
+  if ((MakeDirectory(path2) == 0) ||
+      ((handle = mkstemp(path2)) < 0))
+  {
+    // Directory is not writable
+    return;
+  }
+
+  if ((file = fdopen(handle, "w")) == NULL)
+  {
+    close(handle);
+    unlink(path2);
+    return;
+  }
+
+  result = WriteDebugIndex(unit, index, file);
+
+  if ((fclose(file) != 0) ||
+      (result       == 0) ||
+      (rename(path2, path1) != 0))
+  {
+    // Never leave a partial file
+    unlink(path2);
+  }
+}
+
+// Unit loading
+
+static void ReopenDebugHandle(int handle)
+{
+  int other;
+  char path[64];
+
+  // Inherited descriptor shares its offset with the parent, libdwarf reads sections by seeking
+
+  if ((sprintf(path, "/proc/self/fd/%d", handle) > 0) &&
+      ((other = open(path, O_RDONLY)) >= 0))
+  {
+    dup2(other, handle);
+    close(other);
+  }
+}
+
+static void AdoptDebugUnit(struct DebugUnit* unit)
+{
+  // Called with lock of the unit held, so children which never use the unit (like fork and exec) don't pay for it
+
+  if (unit->lineage != lineage)
+  {
+    unit->lineage = lineage;
+
+    if (unit->handle >= 0)
+      ReopenDebugHandle(unit->handle);
+
+    if (unit->package.instance != NULL)
+      ReopenDebugHandle(unit->package.handle);
+  }
+}
+
+static int LockDebugUnit(struct DebugUnit* unit, int lock)
+{
+  // Lock is held only while the unit is loaded or its tables are built,
+  // so a failure means data is not ready yet and might be requested later
+
+  if ((lock == DEBUG_GET_LOCK_WAIT)      && (pthread_mutex_lock(&unit->lock)    == 0) ||
+      (lock == DEBUG_GET_LOCK_DONT_WAIT) && (pthread_mutex_trylock(&unit->lock) == 0))
+  {
+    AdoptDebugUnit(unit);
+    return 1;
+  }
+
+  if (lock == DEBUG_GET_LOCK_DONT_WAIT)
+  {
+    CountDebugEvent(unit, DEBUG_COUNTER_CONTENTIONS, 1);
+    errno = EAGAIN;
+  }
+
+  return 0;
+}
+
+static struct DebugUnit* FindDebugUnit(struct DebugModule* module, struct DebugUnit* unit, struct DebugUnit* last)
+{
+  // Walk is lock-free and async-signal-safe, units are keyed by file and Build ID,
+  // so a module replaced on disk or reloaded from another file gets its own unit
+
+  for ( ;
+    (unit != last) &&
+    ((unit->device != module->device) ||
+     (unit->inode  != module->inode)  ||
+     (unit->size   != module->size)   ||
+     (memcmp(unit->identifier, module->identifier, module->size) != 0));
+    unit = (struct DebugUnit*)unit->next);
+
+  return (unit != last) ? unit : NULL;
+}
+
+static void OpenDebugFile(struct DebugUnit* unit, int handle)
+{
+  Dwarf_Error error;
+
+  // Replace the binary by a separated debug file
+
+  elf_end(unit->module);
+  close(unit->handle);
+
+  unit->handle = handle;
+  unit->module = NULL;
+
+  if ((unit->handle >= 0) &&
+      (unit->module  = elf_begin(unit->handle, ELF_C_READ, NULL)))
+  {
+    // Result does not matter
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_elf_init(unit->module, DW_DLC_READ, NULL, NULL, &unit->instance, &error);
+#else
+    dwarf_init_b(unit->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &unit->instance, &error);
+#endif
+  }
+}
+
+static void OpenDebugUnit(struct DebugUnit* unit, debuginfod_client* client)
+{
+  int result;
+  size_t size;
+  char* name;
+  struct stat status;
+  char path[PATH_MAX];
+
+  GElf_Shdr header;
+  Dwarf_Error error;
+  uint8_t* identifier;
+
+  // Try to load unit directly from the binary
+
+  unit->handle = open(unit->name, O_RDONLY);
+  unit->module = (unit->handle >= 0) ? elf_begin(unit->handle, ELF_C_READ, NULL) : NULL;
+  identifier   = (unit->module != NULL) ? GetBuildID(unit->module, &size) : NULL;
+
+  if ((identifier != NULL) &&
+      (unit->size != 0)    &&
+      ((size != unit->size) || (memcmp(identifier, unit->identifier, size) != 0)))
+  {
+    // File has been replaced after loading, it does not describe the module anymore
+    elf_end(unit->module);
+    close(unit->handle);
+
+    unit->module = NULL;
+    unit->handle = -1;
+  }
+
+  if ((unit->size != 0) &&
+      (LoadDebugIndex(unit) != 0))
+  {
+    // Persistent index is found, DWARF is not required at all
+    elf_end(unit->module);
+    close(unit->handle);
+
+    unit->module = NULL;
+    unit->handle = -1;
+  }
+
+  if ((unit->module != NULL) &&
+      (GetELFSection(unit->module, ".debug_info", &header) != NULL))
+  {
+    // Result does not matter
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_elf_init(unit->module, DW_DLC_READ, NULL, NULL, &unit->instance, &error);
+#else
+    dwarf_init_b(unit->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &unit->instance, &error);
+#endif
+  }
+
+  // Try to load separated .debug file
+  // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
+
+  identifier = unit->identifier;
+
+  if ((unit->instance == NULL) &&
+      (atomic_load_explicit(&unit->index, memory_order_relaxed) == 0) &&
+      (unit->size     == 20)   &&
+      (sprintf(path, "/usr/lib/debug/.build-id/%02x/%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x.debug",
+        identifier[ 0], identifier[ 1], identifier[ 2], identifier[ 3], identifier[ 4], identifier[ 5], identifier[ 6], identifier[ 7], identifier[ 8], identifier[ 9],
+        identifier[10], identifier[11], identifier[12], identifier[13], identifier[14], identifier[15], identifier[16], identifier[17], identifier[18], identifier[19]) > 0) &&
+      (stat(path, &status) == 0))
+  {
+    // Result does not matter
+    OpenDebugFile(unit, open(path, O_RDONLY));
+  }
+
+  // Try to load file downloaded before, it's kept in the cache of debuginfod client
+
+  if ((unit->instance == NULL) &&
+      (atomic_load_explicit(&unit->index, memory_order_relaxed) == 0) &&
+      (unit->debug    != NULL))
+  {
+    // Result does not matter
+    OpenDebugFile(unit, open(unit->debug, O_RDONLY));
+  }
+
+  // Try to load file from debuginfod, lookups leave it to the fetch queue
+  // https://sourceware.org/elfutils/Debuginfod.html
+
+  name = NULL;
+
+  if ((unit->instance == NULL) &&
+      (atomic_load_explicit(&unit->index, memory_order_relaxed) == 0) &&
+      (unit->size     != 0)    &&
+      (client         != NULL) &&
+      ((result = debuginfod_find_debuginfo(client, unit->identifier, unit->size, &name)) >= 0))
+  {
+    OpenDebugFile(unit, result);
+
+    if (unit->debug == NULL)
+    {
+      // Keep the path for reopening after eviction
+      unit->debug = name;
+      name        = NULL;
+    }
+  }
+
+  free(name);
+
+  // Clean if failed
+
+  if (unit->instance == NULL)
+  {
+    elf_end(unit->module);
+    close(unit->handle);
+
+    unit->module = NULL;
+    unit->handle = -1;
+  }
+
+  // Loaded sections are accounted by the budget
+
+  unit->weight = (unit->module != NULL) ? GetDWARFWeight(unit->module) : 0;
+  atomic_fetch_add_explicit(&usage, unit->weight, memory_order_relaxed);
+}
+
+static struct DebugUnit* CreateDebugUnit(struct DebugModule* module, debuginfod_client* client)
+{
+  uint64_t start;
+  uintptr_t head;
+  struct DebugUnit* unit;
+  struct DebugUnit* other;
+
+  // Shards of counters are aligned to cache lines, the size of the unit is aligned as well
+
+  if ((unit = (struct DebugUnit*)aligned_alloc(DEBUG_LINE_SIZE, sizeof(struct DebugUnit))) == NULL)
+  {
+    // Out of memory
+    return NULL;
+  }
+
+  memset(unit, 0, sizeof(struct DebugUnit));
+
+  if ((unit->name = strdup(module->name)) == NULL)
+  {
+    // Out of memory
+    free(unit);
+    return NULL;
+  }
+
+  // Unit is published locked, so other requesters of the module wait for this load instead of doing their own
+
+  pthread_mutex_init(&unit->lock, NULL);
+  pthread_mutex_init(&unit->interner, NULL);
+  pthread_mutex_lock(&unit->lock);
+
+  unit->handle  = -1;
+  unit->lineage = lineage;
+  unit->device  = module->device;
+  unit->inode  = module->inode;
+  unit->size   = module->size;
+  memcpy(unit->identifier, module->identifier, module->size);
+
+  head = atomic_load_explicit(&cache, memory_order_acquire);
+
+  do
+  {
+    if (other = FindDebugUnit(module, (struct DebugUnit*)head, (struct DebugUnit*)unit->next))
+    {
+      // Another thread has added the same module meanwhile
+      pthread_mutex_unlock(&unit->lock);
+      pthread_mutex_destroy(&unit->lock);
+      pthread_mutex_destroy(&unit->interner);
+      free(unit->name);
+      free(unit);
+      return other;
+    }
+
+    unit->next = head;
+  }
+  while (!atomic_compare_exchange_strong_explicit(&cache, &head, (uintptr_t)unit, memory_order_acq_rel, memory_order_acquire));
+
+  start = GetDebugTime();
+  OpenDebugUnit(unit, client);
+  CountDebugTime(unit, DEBUG_TIER_OPEN, start);
+
+  atomic_store_explicit(&unit->ready, 1, memory_order_release);
+  pthread_mutex_unlock(&unit->lock);
+  return unit;
+}
+
+static struct DebugUnit* GetDebugUnit(struct DebugModule* module, debuginfod_client* client, int lock)
+{
+  struct DebugUnit* unit;
+
+  // Try to find a unit of the module, create a new unit otherwise
+
+  if ((module == NULL) ||
+      (unit = (struct DebugUnit*)atomic_load_explicit(&module->unit, memory_order_acquire)))
+  {
+    // Module is not accessible or already resolved
+    return (module != NULL) ? unit : NULL;
+  }
+
+  if (((unit = FindDebugUnit(module, (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire), NULL)) == NULL) &&
+      ((module->name == NULL) ||
+       ((unit = CreateDebugUnit(module, client)) == NULL)))
+  {
+    // Module is not accessible
+    return NULL;
+  }
+
+  if (atomic_load_explicit(&unit->ready, memory_order_acquire) == 0)
+  {
+    // Unit is being loaded by another thread, wait for it only when allowed
+    if (LockDebugUnit(unit, lock) == 0)
+      return NULL;
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  // Next lookups through the module skip the walk
+  atomic_store_explicit(&module->unit, (uintptr_t)unit, memory_order_release);
+  return unit;
+}
+
+// Background fetch
+
+static long GetMonotonicTime()
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec;
+}
+
+static int HandleFetchProgress(debuginfod_client* client, long value1, long value2)
+{
+  // Download is aborted by timeout or by exit of the process
+
+  return
+    (atomic_load_explicit(&closing, memory_order_relaxed) != 0) ||
+    (GetMonotonicTime() > *(long*)debuginfod_get_user_data(client));
+}
+
+static void* DoFetch(void* argument)
+{
+  int result;
+  long time;
+  long deadline;
+  uint64_t start;
+  char* name;
+  struct DebugUnit* unit;
+  debuginfod_client* client;
+
+  pthread_detach(pthread_self());
+  pthread_setname_np(pthread_self(), "Fetcher");
+
+  // debuginfod client is not thread-safe, each fetcher has its own one
+
+  if (client = debuginfod_begin())
+  {
+    debuginfod_set_user_data(client, &deadline);
+    debuginfod_set_progressfn(client, HandleFetchProgress);
+  }
+
+  pthread_mutex_lock(&fetcher);
+
+  while (unit = fetches)
+  {
+    fetches = unit->queue;
+    pthread_mutex_unlock(&fetcher);
+
+    name     = NULL;
+    result   = -1;
+    start    = GetDebugTime();
+    deadline = GetMonotonicTime() + DEBUG_FETCH_TIMEOUT;
+
+    if ((client != NULL) &&
+        (atomic_load_explicit(&closing, memory_order_relaxed) == 0))
+    {
+      result = debuginfod_find_debuginfo(client, unit->identifier, unit->size, &name);
+      CountDebugTime(unit, DEBUG_TIER_FETCH, start);
+    }
+
+    if (result >= 0)
+    {
+      // The file is opened again by path, so it could be reopened after eviction too
+      close(result);
+      pthread_mutex_lock(&unit->lock);
+
+      if ((unit->instance == NULL) &&
+          (unit->debug    == NULL) &&
+          (atomic_load_explicit(&unit->index,   memory_order_relaxed) == 0) &&
+          (atomic_load_explicit(&unit->evicted, memory_order_relaxed) == 0))
+      {
+        unit->debug = name;
+        name        = NULL;
+
+        OpenDebugUnit(unit, NULL);
+        ClearMissCache(unit);
+      }
+
+      result = (unit->instance != NULL) || (atomic_load_explicit(&unit->index, memory_order_relaxed) != 0) ? 0 : -1;
+      pthread_mutex_unlock(&unit->lock);
+
+      // Lookups might be repeated to get better data
+      atomic_fetch_add_explicit(&revision, result == 0, memory_order_release);
+    }
+
+    free(name);
+    pthread_mutex_lock(&fetcher);
+
+    // Failures are retried with exponential backoff, remembered per unit and so per Build ID
+
+    CountDebugEvent(unit, (result < 0) ? DEBUG_COUNTER_FAILURES : DEBUG_COUNTER_FETCHES, 1);
+
+    unit->failures = (result < 0) ? unit->failures + 1 : 0;
+    time           = (unit->failures < 8) ? ((long)DEBUG_FETCH_BACKOFF << unit->failures) / 2 : DEBUG_FETCH_PATIENCE;
+    time           = (time < DEBUG_FETCH_PATIENCE) ? time : DEBUG_FETCH_PATIENCE;
+
+    atomic_store_explicit(&unit->retry, GetMonotonicTime() + time, memory_order_relaxed);
+    atomic_store_explicit(&unit->fetching, 0, memory_order_release);
+  }
+
+  fetchers --;
+  pthread_cond_broadcast(&fetched);
+  pthread_mutex_unlock(&fetcher);
+
+  if (client != NULL)
+  {
+    // Result does not matter
+    debuginfod_end(client);
+  }
+
+  return NULL;
+}
+
+static void RequestDebugFetch(struct DebugUnit* unit, int lock)
+{
+  pthread_t thread;
+
+  // Lookups never wait for network, a unit without debug information is queued for a bounded pool of fetchers,
+  // neither heap nor threads are allowed in async-signal-safe mode
+
+  if ((lock == DEBUG_GET_SIGNAL_SAFE) ||
+      (unit->size == 0) ||
+      (atomic_load_explicit(&unit->fetching, memory_order_acquire) != 0) ||
+      (atomic_load_explicit(&unit->retry,    memory_order_relaxed) > GetMonotonicTime()) ||
+      (atomic_load_explicit(&closing,        memory_order_relaxed) != 0) ||
+      (lock == DEBUG_GET_LOCK_WAIT)      && (pthread_mutex_lock(&fetcher)    != 0) ||
+      (lock == DEBUG_GET_LOCK_DONT_WAIT) && (pthread_mutex_trylock(&fetcher) != 0))
+  {
+    // Fetch is not allowed or not required
+    return;
+  }
+
+  if (atomic_load_explicit(&unit->fetching, memory_order_relaxed) == 0)
+  {
+    atomic_store_explicit(&unit->fetching, 1, memory_order_relaxed);
+    unit->queue = fetches;
+    fetches     = unit;
+  }
+
+  if ((fetchers < DEBUG_FETCH_LIMIT) &&
+      (pthread_create(&thread, NULL, DoFetch, NULL) == 0))
+  {
+    // Fetcher leaves when the queue is empty
+    fetchers ++;
+  }
+
+  pthread_mutex_unlock(&fetcher);
+}
+
+unsigned int GetDebugCacheRevision()
+{
+  return atomic_load_explicit(&revision, memory_order_acquire);
+}
+
+// Module map
+
+static int CompareSegments(const void* pointer1, const void* pointer2)
+{
+  struct DebugSegment* segment1;
+  struct DebugSegment* segment2;
+
+  segment1 = (struct DebugSegment*)pointer1;
+  segment2 = (struct DebugSegment*)pointer2;
+
+  return (segment1->start > segment2->start) - (segment1->start < segment2->start);
+}
+
+static int HandleCounterHeader(struct dl_phdr_info* information, size_t size, void* data)
+{
+  unsigned long long* counters;
+
+  // Counters are the same for all modules, the first one is enough
+
+  counters    = (unsigned long long*)data;
+  counters[0] = information->dlpi_adds;
+  counters[1] = information->dlpi_subs;
+
+  return 1;
+}
+
+static struct DebugSegment* FindDebugSegment(struct DebugArena* current, uintptr_t address)
+{
+  size_t low;
+  size_t high;
+  size_t middle;
+
+  // Called inside the cache, retired arenas are unmapped when readers leave
+
+  if (current == NULL)
+  {
+    // Module map has never been built
+    return NULL;
+  }
+
+  low  = 0;
+  high = current->length;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+
+    if (current->segments[middle].start <= address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return
+    (low != 0) &&
+    (address < current->segments[low - 1].end) ?
+    current->segments + low - 1                :
+    NULL;
+}
+
+static struct DebugModule* FindPreviousModule(struct SegmentList* list, struct dl_phdr_info* information, struct DebugModule* module)
+{
+  const ElfW(Phdr)* header;
+  const ElfW(Phdr)* limit;
+  struct DebugSegment* segment;
+
+  // Module still loaded at the same address with the same Build ID is taken from the previous module map without stat()
+
+  header = information->dlpi_phdr;
+  limit  = information->dlpi_phdr + information->dlpi_phnum;
+
+  for ( ; (header < limit) && (header->p_type != PT_LOAD); header ++);
+
+  if ((module->size == 0) ||
+      (header == limit) ||
+      (segment = FindDebugSegment(list->previous, information->dlpi_addr + header->p_vaddr)) == NULL ||
+      (segment->base         != information->dlpi_addr) ||
+      (segment->module->name == NULL) ||
+      (segment->module->size != module->size) ||
+      (memcmp(segment->module->identifier, module->identifier, module->size) != 0))
+  {
+    // Module is new or it has been reloaded from another file
+    return NULL;
+  }
+
+  return segment->module;
+}
+
+static int HandleSegmentHeader(struct dl_phdr_info* information, size_t size, void* data)
+{
+  struct SegmentList* list;
+  struct DebugModule* module;
+  struct DebugModule* previous;
+  struct DebugSegment* segment;
+  const ElfW(Phdr)* header;
+  const ElfW(Phdr)* limit;
+  struct stat status;
+  const char* name;
+
+  list   = (struct SegmentList*)data;
+  header = information->dlpi_phdr;
+  limit  = information->dlpi_phdr + information->dlpi_phnum;
+  name   = (*information->dlpi_name != '\0') ? information->dlpi_name : list->name;  // Main program has an empty name
+
+  list->adds = information->dlpi_adds;
+  list->subs = information->dlpi_subs;
+
+  if ((list->count == list->capacity) &&
+      (module = (struct DebugModule*)realloc(list->modules, (list->capacity + 64) * sizeof(struct DebugModule))))
+  {
+    list->modules   = module;
+    list->capacity += 64;
+  }
+
+  if (list->count == list->capacity)
+  {
+    // Out of memory, skip the module
+    return 0;
+  }
+
+  module = list->modules + list->count;
+  memset(module, 0, sizeof(struct DebugModule));
+  atomic_init(&module->unit, 0);
+
+  module->size = GetModuleBuildID(information, module->identifier, sizeof(module->identifier));
+
+  if (previous = FindPreviousModule(list, information, module))
+  {
+    // Name is interned, the unit is attached already
+    module->name   = previous->name;
+    module->device = previous->device;
+    module->inode  = previous->inode;
+    atomic_init(&module->unit, atomic_load_explicit(&previous->unit, memory_order_acquire));
+  }
+  else if (stat(name, &status) == 0)
+  {
+    // Retreive units with accessible path only
+    module->name   = InternString(&images, name);
+    module->device = status.st_dev;
+    module->inode  = status.st_ino;
+  }
+
+  for ( ; header < limit; header ++)
+  {
+    if ((header->p_type == PT_LOAD) &&
+        (list->length == list->size) &&
+        (segment = (struct DebugSegment*)realloc(list->data, (list->size + 64) * sizeof(struct DebugSegment))))
+    {
+      list->data  = segment;
+      list->size += 64;
+    }
+
+    if ((header->p_type == PT_LOAD) &&
+        (list->length < list->size))
+    {
+      segment         = list->data + list->length;
+      segment->start  = information->dlpi_addr + header->p_vaddr;
+      segment->end    = information->dlpi_addr + header->p_vaddr + header->p_memsz;
+      segment->base   = information->dlpi_addr;
+      segment->module = (struct DebugModule*)(uintptr_t)list->count;
+      list->length ++;
+    }
+  }
+
+  list->count ++;
+  return 0;
+}
+
+static int IsDebugUnitMapped(struct DebugArena* current, struct DebugUnit* unit)
+{
+  struct DebugModule* module;
+
+  for (module = current->modules; module < current->modules + current->count; module ++)
+  {
+    if ((module->name != NULL) &&
+        (FindDebugUnit(module, unit, (struct DebugUnit*)unit->next) != NULL))
+      return 1;
+  }
+
+  return 0;
+}
+
+static void RetireDebugArenas(struct DebugArena* current, int lock)
+{
+  struct DebugArena* previous;
+  struct DebugModule* module;
+  struct DebugUnit* unit;
+
+  // Called with refresher and trimmer held, previous arenas are unmapped when readers leave,
+  // units of unloaded modules keep only their shells and interned strings
+
+  while (previous = (struct DebugArena*)current->next)
+  {
+    for (module = previous->modules; module < previous->modules + previous->count; module ++)
+    {
+      if ((unit = (struct DebugUnit*)atomic_load_explicit(&module->unit, memory_order_acquire)) &&
+          (IsDebugUnitMapped(current, unit) == 0) &&
+          (LockDebugUnit(unit, lock) != 0))
+      {
+        EvictDebugUnit(unit);
+        pthread_mutex_unlock(&unit->lock);
+      }
+    }
+
+    if (ReserveDebugRetiree() == 0)
+    {
+      // Out of memory, the arena is retired by the next rebuild
+      break;
+    }
+
+    current->next = previous->next;
+    RetireDebugObject(DEBUG_RETIRE_ARENA, previous, 0);
+  }
+}
+
+static struct DebugArena* BuildDebugArena(int lock)
+{
+  size_t size;
+  size_t number;
+  char* program;
+  struct SegmentList list;
+  struct DebugUnit* unit;
+  struct DebugArena* current;
+  struct DebugModule* module;
+
+  // Called with refresher held, snapshot of segments and modules is allocated at once,
+  // an async-signal-safe lookup uses nothing else
+
+  program = (char*)alloca(PATH_MAX);
+  memset(program, 0, PATH_MAX);
+  readlink("/proc/self/exe", program, PATH_MAX - 1);
+
+  memset(&list, 0, sizeof(struct SegmentList));
+  list.name     = program;
+  list.previous = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_relaxed);
+
+  dl_iterate_phdr(HandleSegmentHeader, &list);
+  qsort(list.data, list.length, sizeof(struct DebugSegment), CompareSegments);
+
+  size    = sizeof(struct DebugArena) + list.length * sizeof(struct DebugSegment) + list.count * sizeof(struct DebugModule);
+  current = (struct DebugArena*)mmap(NULL, size, PROT_WRITE | PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (current != MAP_FAILED)
+  {
+    current->size     = size;
+    current->adds     = list.adds;
+    current->subs     = list.subs;
+    current->length   = list.length;
+    current->segments = (struct DebugSegment*)(current + 1);
+    current->count    = list.count;
+    current->modules  = (struct DebugModule*)(current->segments + list.length);
+
+    memcpy(current->segments, list.data, list.length * sizeof(struct DebugSegment));
+    memcpy(current->modules, list.modules, list.count * sizeof(struct DebugModule));
+
+    for (number = 0; number < list.length; number ++)
+      current->segments[number].module = current->modules + (uintptr_t)current->segments[number].module;
+
+    for (module = current->modules; module < current->modules + list.count; module ++)
+    {
+      if ((module->name != NULL) &&
+          (atomic_load_explicit(&module->unit, memory_order_relaxed) == 0))
+      {
+        // Units already loaded are attached at once
+        unit = FindDebugUnit(module, (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire), NULL);
+
+        if ((unit != NULL) &&
+            (atomic_load_explicit(&unit->ready, memory_order_acquire) != 0))
+          atomic_init(&module->unit, (uintptr_t)unit);
+      }
+    }
+
+    // Previous arena could still be used by readers, it's retired through the cache
+
+    current->next = (uintptr_t)list.previous;
+    atomic_store_explicit(&arena, (uintptr_t)current, memory_order_release);
+
+    if ((list.previous != NULL) &&
+        (list.previous->subs != current->subs))
+    {
+      // Modules have been unloaded, other ones could be loaded at the same addresses
+      atomic_fetch_add_explicit(&validity, 1, memory_order_release);
+    }
+
+    if ((lock == DEBUG_GET_LOCK_WAIT)      && (pthread_mutex_lock(&trimmer)    == 0) ||
+        (lock == DEBUG_GET_LOCK_DONT_WAIT) && (pthread_mutex_trylock(&trimmer) == 0))
+    {
+      // Otherwise previous arenas are retired by the next refresh
+      RetireDebugArenas(current, lock);
+      ReclaimDebugCache();
+      pthread_mutex_unlock(&trimmer);
+    }
+  }
+
+  free(list.modules);
+  free(list.data);
+
+  return (current != MAP_FAILED) ? current : NULL;
+}
+
+static struct DebugArena* RefreshDebugArena(int lock)
+{
+  struct DebugArena* current;
+  unsigned long long counters[2];
+
+  // Arena is rebuilt only when dlopen() or dlclose() changed the set of modules
+
+  current = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_acquire);
+
+  dl_iterate_phdr(HandleCounterHeader, counters);
+
+  if (((current == NULL) ||
+       (current->adds != counters[0]) ||
+       (current->subs != counters[1])) &&
+      ((lock == DEBUG_GET_LOCK_WAIT)      && (pthread_mutex_lock(&refresher)    == 0) ||
+       (lock == DEBUG_GET_LOCK_DONT_WAIT) && (pthread_mutex_trylock(&refresher) == 0)))
+  {
+    current = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_relaxed);
+
+    if ((current == NULL) ||
+        (current->adds != counters[0]) ||
+        (current->subs != counters[1]))
+    {
+      // Nobody has rebuilt it in the meantime, keep the old one when out of memory
+      current = BuildDebugArena(lock) ? : current;
+    }
+
+    pthread_mutex_unlock(&refresher);
+  }
+
+  return current;
 }
 
 // Search routines
 
-static int CompareAddresses(const void* pointer1, const void* pointer2)
+static int CompareAddresses(const void* pointer1, const void* pointer2)
+{
+  struct SourceLine* line1;
+  struct SourceLine* line2;
+
+  line1 = (struct SourceLine*)pointer1;
+  line2 = (struct SourceLine*)pointer2;
+
+  return (line1->address > line2->address) - (line1->address < line2->address);
+}
+
+static int CompareRanges(const void* pointer1, const void* pointer2)
+{
+  struct DebugRange* range1;
+  struct DebugRange* range2;
+
+  range1 = (struct DebugRange*)pointer1;
+  range2 = (struct DebugRange*)pointer2;
+
+  return
+    (range1->low > range2->low) - (range1->low < range2->low) ?:
+    (range1->high < range2->high) - (range1->high > range2->high);
+}
+
+static void AppendRangeList(struct RangeList* list, Dwarf_Addr low, Dwarf_Addr high, Dwarf_Off offset)
+{
+  struct DebugRange* data;
+
+  if ((low  >= high) ||
+      (low  == 0)    ||
+      (high >= (Dwarf_Addr)-2))
+  {
+    // Skip empty ranges and tombstones of discarded sections
+    return;
+  }
+
+  if ((list->length == list->size) &&
+      (data = (struct DebugRange*)realloc(list->data, (list->size + 1024) * sizeof(struct DebugRange))))
+  {
+    list->data  = data;
+    list->size += 1024;
+  }
+
+  if (list->length < list->size)
+  {
+    list->data[list->length].low    = low;
+    list->data[list->length].high   = high;
+    list->data[list->length].offset = offset;
+    list->length ++;
+  }
+}
+
+static size_t CollectRanges(struct DebugUnit* unit, Dwarf_Debug instance, Dwarf_Die entry, Dwarf_Off offset, struct RangeList* list)
+{
+  Dwarf_Half form;
+  Dwarf_Error error;
+  Dwarf_Unsigned low;
+  Dwarf_Unsigned high;
+  enum Dwarf_Form_Class type;
+
+  size_t length;
+  Dwarf_Off value;
+  Dwarf_Signed index;
+  Dwarf_Signed count;
+  Dwarf_Ranges* ranges;
+  Dwarf_Unsigned size;
+  Dwarf_Attribute attribute;
+
+#ifdef DW_LIBDWARF_VERSION
+  unsigned code;
+  unsigned width;
+  Dwarf_Half version;
+  Dwarf_Half dummy;
+  Dwarf_Bool missing;
+  Dwarf_Unsigned raw1;
+  Dwarf_Unsigned raw2;
+  Dwarf_Unsigned number;
+  Dwarf_Rnglists_Head head;
+#endif
+
+  low    = 0;
+  high   = 0;
+  length = list->length;
+
+  if ((dwarf_lowpc(entry, &low, &error)                   == DW_DLV_OK) &&
+      (dwarf_highpc_b(entry, &high, &form, &type, &error) == DW_DLV_OK))
+  {
+    high += low * (type == DW_FORM_CLASS_CONSTANT);
+    AppendRangeList(list, low, high, offset);
+    return list->length - length;
+  }
+
+  if (dwarf_attr(entry, DW_AT_ranges, &attribute, &error) == DW_DLV_OK)
+  {
+#ifdef DW_LIBDWARF_VERSION
+    // DWARF 5 keeps ranges in .debug_rnglists, addresses are cooked by libdwarf
+
+    if ((dwarf_get_version_of_die(entry, &version, &dummy) == DW_DLV_OK) &&
+        (version >= 5))
+    {
+      if ((dwarf_whatform(attribute, &form, &error) == DW_DLV_OK) &&
+          ((form == DW_FORM_rnglistx) && (dwarf_formudata(attribute, &value, &error)      == DW_DLV_OK) ||
+           (form != DW_FORM_rnglistx) && (dwarf_global_formref(attribute, &value, &error) == DW_DLV_OK)) &&
+          (dwarf_rnglists_get_rle_head(attribute, form, value, &head, &size, &number, &error) == DW_DLV_OK))
+      {
+        for (number = 0; number < size; ++ number)
+        {
+          if ((dwarf_get_rnglists_entry_fields_a(head, number, &width, &code, &raw1, &raw2, &missing, &low, &high, &error) != DW_DLV_OK) ||
+              (code == DW_RLE_end_of_list))
+          {
+            // End of the list or broken entry
+            break;
+          }
+
+          if ((missing == 0) &&
+              (code != DW_RLE_base_address) &&
+              (code != DW_RLE_base_addressx))
+          {
+            // Base address entries are already applied
+            AppendRangeList(list, low, high, offset);
+          }
+        }
+
+        dwarf_dealloc_rnglists_head(head);
+      }
+
+      dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+      return list->length - length;
+    }
+
+    if ((dwarf_global_formref(attribute, &value, &error)                                           == DW_DLV_OK) &&
+        (dwarf_get_ranges_b(instance, value, entry, NULL, &ranges, &count, &size, &error) == DW_DLV_OK))
+#else
+    if ((dwarf_global_formref(attribute, &value, &error)                                    == DW_DLV_OK) &&
+        (dwarf_get_ranges_a(instance, value, entry, &ranges, &count, &size, &error) == DW_DLV_OK))
+#endif
+    {
+      // DWARF 4 ranges are relative to the base address of compilation unit
+
+      for (index = 0; index < count; ++ index)
+      {
+        if (ranges[index].dwr_type == DW_RANGES_END)
+          break;
+
+        if (ranges[index].dwr_type == DW_RANGES_ADDRESS_SELECTION)
+        {
+          low = ranges[index].dwr_addr2;
+          continue;
+        }
+
+        if (ranges[index].dwr_addr1 != 0)
+        {
+          // Zero is used by linkers for discarded functions
+          AppendRangeList(list, ranges[index].dwr_addr1 + low, ranges[index].dwr_addr2 + low, offset);
+        }
+      }
+
+#ifndef DW_LIBDWARF_VERSION
+      dwarf_ranges_dealloc(instance, ranges, count);
+#else
+      dwarf_dealloc_ranges(instance, ranges, count);
+#endif
+    }
+
+    dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+  }
+
+  return list->length - length;
+}
+
+static size_t CollectChildRanges(struct DebugUnit* unit, Dwarf_Debug instance, Dwarf_Die entry, Dwarf_Off offset, struct RangeList* list)
+{
+  int result;
+  size_t length;
+
+  Dwarf_Die current;
+  Dwarf_Die previous;
+
+  Dwarf_Half tag;
+  Dwarf_Bool flag;
+  Dwarf_Error error;
+  Dwarf_Attribute attribute;
+
+  length = list->length;
+
+  if (dwarf_child(entry, &current, &error) == DW_DLV_OK)
+  {
+    do
+    {
+      tag = 0;
+
+      if ((dwarf_tag(current, &tag, &error) == DW_DLV_OK) &&
+          ((tag == DW_TAG_subprogram) || (tag == DW_TAG_inlined_subroutine)))
+      {
+        // Only functions are interesting, inlined subroutines are covered by outer ones
+        CollectRanges(unit, instance, current, offset, list);
+      }
+      else if (dwarf_attr(current, DW_AT_declaration, &attribute, &error) == DW_DLV_OK)
+      {
+        flag = 0;
+        dwarf_formflag(attribute, &flag, &error);
+        dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+
+        if (flag != 0)
+        {
+          // Definitions could be nested into a declaration
+          CollectChildRanges(unit, instance, current, offset, list);
+        }
+      }
+      else if (tag == DW_TAG_namespace)
+      {
+        // Functions of C++ are usually nested into namespaces
+        CollectChildRanges(unit, instance, current, offset, list);
+      }
+
+#ifndef DW_LIBDWARF_VERSION
+      previous = current;
+      result   = dwarf_siblingof(instance, previous, &current, &error);
+#else
+      previous = current;
+      result   = dwarf_siblingof_b(instance, previous, 1, &current, &error);
+#endif
+
+      dwarf_dealloc(instance, previous, DW_DLA_DIE);
+    }
+    while (result == DW_DLV_OK);
+  }
+
+  return list->length - length;
+}
+
+static void CollectArangeList(struct DebugUnit* unit, struct RangeList* list)
+{
+  Dwarf_Off offset;
+  Dwarf_Error error;
+  Dwarf_Addr start;
+  Dwarf_Signed count;
+  Dwarf_Arange* aranges;
+  Dwarf_Unsigned length;
+  Dwarf_Unsigned segment;
+  Dwarf_Unsigned size;
+
+  if (dwarf_get_aranges(unit->instance, &aranges, &count, &error) == DW_DLV_OK)
+  {
+    while (count > 0)
+    {
+      count --;
+
+      if (dwarf_get_arange_info_b(aranges[count], &segment, &size, &start, &length, &offset, &error) == DW_DLV_OK)
+      {
+        // Offset of CU DIE is returned
+        AppendRangeList(list, start, start + length, offset);
+        CountDebugEvent(unit, DEBUG_COUNTER_ARANGES, 1);
+      }
+
+      dwarf_dealloc(unit->instance, aranges[count], DW_DLA_ARANGE);
+    }
+
+    dwarf_dealloc(unit->instance, aranges, DW_DLA_LIST);
+  }
+}
+
+static size_t CollectUnitOffsets(struct DebugUnit* unit, Dwarf_Off** offsets)
+{
+  size_t size;
+  size_t count;
+  Dwarf_Die entry;
+  Dwarf_Half tag;
+  Dwarf_Off offset;
+  Dwarf_Off* data;
+  Dwarf_Error error;
+  Dwarf_Unsigned next;
+
+  // Headers could be walked only sequentially, compilation units are processed by offsets of their DIEs
+
+  size  = 0;
+  count = 0;
+  next  = 0;
+  entry = NULL;
+
+  while (dwarf_next_cu_header_d(unit->instance, 1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &next, NULL, &error) == DW_DLV_OK)
+  {
+#ifndef DW_LIBDWARF_VERSION
+    if ((dwarf_siblingof(unit->instance, NULL, &entry, &error) == DW_DLV_OK) &&
+#else
+    if ((dwarf_siblingof_b(unit->instance, NULL, 1, &entry, &error) == DW_DLV_OK) &&
+#endif
+        (dwarf_dieoffset(entry, &offset, &error) == DW_DLV_OK) &&
+        (dwarf_tag(entry, &tag, &error)          == DW_DLV_OK) &&
+        ((tag == DW_TAG_compile_unit) || (tag == DW_TAG_skeleton_unit)))
+    {
+      if ((count == size) &&
+          (data = (Dwarf_Off*)realloc(*offsets, (size + 256) * sizeof(Dwarf_Off))))
+      {
+        *offsets = data;
+        size    += 256;
+      }
+
+      if (count < size)
+      {
+        // Skip the unit when out of memory
+        (*offsets)[count ++] = offset;
+      }
+    }
+
+    if (entry != NULL)
+    {
+      dwarf_dealloc(unit->instance, entry, DW_DLA_DIE);
+      entry = NULL;
+    }
+  }
+
+  return count;
+}
+
+static void CollectUnitRanges(struct DebugUnit* unit, Dwarf_Debug instance, Dwarf_Off offset, struct RangeList* list)
+{
+  size_t count;
+  Dwarf_Die entry;
+  Dwarf_Error error;
+
+  if (dwarf_offdie_b(instance, offset, 1, &entry, &error) == DW_DLV_OK)
+  {
+    if ((count = CollectRanges(unit, instance, entry, offset, list)) == 0)
+    {
+      // Compilation unit has no own ranges, look at all its functions
+      CountDebugEvent(unit, DEBUG_COUNTER_WALKS, CollectChildRanges(unit, instance, entry, offset, list));
+    }
+
+    CountDebugEvent(unit, DEBUG_COUNTER_SCANS, count);
+    dwarf_dealloc(instance, entry, DW_DLA_DIE);
+  }
+}
+
+static void CollectUnitList(struct DebugUnit* unit, struct RangeList* list)
+{
+  size_t count;
+  size_t number;
+  Dwarf_Off* offsets;
+
+  offsets = NULL;
+  count   = CollectUnitOffsets(unit, &offsets);
+
+  for (number = 0; number < count; number ++)
+    CollectUnitRanges(unit, unit->instance, offsets[number], list);
+
+  free(offsets);
+}
+
+static int CompareOffsets(const void* pointer1, const void* pointer2)
+{
+  struct SourceSlot* slot1;
+  struct SourceSlot* slot2;
+
+  slot1 = (struct SourceSlot*)pointer1;
+  slot2 = (struct SourceSlot*)pointer2;
+
+  return (slot1->offset > slot2->offset) - (slot1->offset < slot2->offset);
+}
+
+static struct DebugIndex* MakeDebugIndex(struct RangeList* list)
+{
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct DebugRange* limit;
+  struct DebugRange* last;
+  struct SourceSlot* slot;
+  struct SourceSlot key;
+
+  if ((index = (struct DebugIndex*)calloc(1, sizeof(struct DebugIndex))) == NULL)
+  {
+    free(list->data);
+    return NULL;
+  }
+
+  if (list->length != 0)
+  {
+    qsort(list->data, list->length, sizeof(struct DebugRange), CompareRanges);
+
+    // Make ranges disjoint, the first range wins
+
+    range = list->data + 1;
+    limit = list->data + list->length;
+    last  = list->data;
+
+    while (range < limit)
+    {
+      if (range->high > last->high)
+      {
+        last ++;
+        last->low    = (range->low > (last - 1)->high) ? range->low : (last - 1)->high;
+        last->high   = range->high;
+        last->offset = range->offset;
+      }
+
+      range ++;
+    }
+
+    index->length = last - list->data + 1;
+    index->ranges = (struct DebugRange*)realloc(list->data, index->length * sizeof(struct DebugRange)) ?: list->data;
+
+    // Make a slot for every compilation unit, line tables are built in slots on demand
+
+    if (index->slots = (struct SourceSlot*)calloc(index->length, sizeof(struct SourceSlot)))
+    {
+      for (range = index->ranges; range < index->ranges + index->length; range ++)
+        index->slots[range - index->ranges].offset = range->offset;
+
+      qsort(index->slots, index->length, sizeof(struct SourceSlot), CompareOffsets);
+
+      for (slot = index->slots; slot < index->slots + index->length; slot ++)
+      {
+        if ((index->count == 0) ||
+            (index->slots[index->count - 1].offset != slot->offset))
+        {
+          index->slots[index->count].offset = slot->offset;
+          index->count ++;
+        }
+      }
+
+      for (range = index->ranges; range < index->ranges + index->length; range ++)
+      {
+        key.offset    = range->offset;
+        slot          = (struct SourceSlot*)bsearch(&key, index->slots, index->count, sizeof(struct SourceSlot), CompareOffsets);
+        range->number = slot - index->slots;
+      }
+    }
+    else
+    {
+      // Index without slots is useless
+      index->length = 0;
+    }
+  }
+
+  return index;
+}
+
+static struct DebugIndex* BuildDebugIndex(struct DebugUnit* unit)
+{
+  struct RangeList list;
+
+  // Collect ranges from all available sources once:
+  // .debug_aranges, high/low PCs and ranges of compilation units, ranges of functions
+
+  list.data   = NULL;
+  list.size   = 0;
+  list.length = 0;
+
+  CollectArangeList(unit, &list);
+  CollectUnitList(unit, &list);
+
+  return MakeDebugIndex(&list);
+}
+
+static struct DebugRange* FindDebugRange(struct DebugIndex* index, Dwarf_Addr address)
+{
+  size_t low;
+  size_t high;
+  size_t middle;
+
+  low  = 0;
+  high = index->length;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+
+    if (index->ranges[middle].low <= address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return
+    (low != 0) &&
+    (address < index->ranges[low - 1].high) ?
+    index->ranges + low - 1                 :
+    NULL;
+}
+
+// Code resolution
+
+static void FillSourceBlocks(struct SourceTable* source, struct SourceLine* list, size_t* number, size_t index)
+{
+  size_t first;
+  size_t last;
+
+  // Eytzinger layout keeps the top levels of the search tree in the same cache lines
+  // https://algorithmica.org/en/eytzinger
+
+  if (index <= source->count)
+  {
+    FillSourceBlocks(source, list, number, index * 2);
+
+    first = *number * SOURCE_BLOCK_SIZE;
+    last  = first + SOURCE_BLOCK_SIZE - 1;
+
+    if (last >= source->length)
+    {
+      // The last block could be incomplete
+      last = source->length - 1;
+    }
+
+    source->blocks[index].limit  = list[last].address;
+    source->blocks[index].offset = list[last].address - list[first].address;
+    source->blocks[index].number = *number;
+    (*number) ++;
+
+    FillSourceBlocks(source, list, number, index * 2 + 1);
+  }
+}
+
+static uint32_t GetSourceFile(struct DebugUnit* unit, Dwarf_Debug instance, struct SourceTable* source, Dwarf_Line line, uint32_t** map, size_t* size)
+{
+  Dwarf_Unsigned number;
+  Dwarf_Error error;
+  uint32_t* pointer;
+  char* name;
+
+  // Map line program file numbers to the compact file table, resolve every path only once
+
+  if (dwarf_line_srcfileno(line, &number, &error) != DW_DLV_OK)
+  {
+    // Line has no file, index 0 is used for the same purpose in DWARF 4
+    number = 0;
+  }
+
+  if ((number >= *size) &&
+      (pointer = (uint32_t*)realloc(*map, (number + 1) * sizeof(uint32_t))))
+  {
+    memset(pointer + *size, 0, (number + 1 - *size) * sizeof(uint32_t));
+    *map  = pointer;
+    *size = number + 1;
+  }
+
+  if ((number < *size) &&
+      ((*map)[number] == 0) &&
+      (dwarf_linesrc(line, &name, &error) == DW_DLV_OK))
+  {
+    if (source->files[source->number] = InternUnitString(unit, name))
+    {
+      source->number ++;
+      (*map)[number] = source->number;
+    }
+
+    dwarf_dealloc(instance, name, DW_DLA_STRING);
+  }
+
+  return
+    (number < *size)      &&
+    ((*map)[number] != 0) ?
+    (*map)[number] - 1    :
+    UINT32_MAX;
+}
+
+static int CompareFrames(const void* pointer1, const void* pointer2)
+{
+  struct SourceFrame* frame1;
+  struct SourceFrame* frame2;
+
+  frame1 = (struct SourceFrame*)pointer1;
+  frame2 = (struct SourceFrame*)pointer2;
+
+  // Enclosing frames go first when ranges start at the same address
+
+  return
+    (frame1->low > frame2->low) - (frame1->low < frame2->low) ?
+    (frame1->low > frame2->low) - (frame1->low < frame2->low) :
+    (frame1->number > frame2->number) - (frame1->number < frame2->number);
+}
+
+static int CompareNames(const void* pointer1, const void* pointer2)
+{
+  uintptr_t name1;
+  uintptr_t name2;
+
+  // Names are interned, so pointers are enough
+
+  name1 = *(uintptr_t*)pointer1;
+  name2 = *(uintptr_t*)pointer2;
+
+  return (name1 > name2) - (name1 < name2);
+}
+
+static const char* GetFunctionName(struct DebugUnit* unit, Dwarf_Debug instance, Dwarf_Die entry, int depth)
+{
+  char* name;
+  char* readable;
+  Dwarf_Off offset;
+  Dwarf_Die origin;
+  Dwarf_Error error;
+  Dwarf_Attribute attribute;
+  const char* result;
+
+  // Linkage name is preferred, it is unique and its demangled form is qualified,
+  // tables are never built in async-signal-safe mode, so the name is demangled once here
+
+  if ((dwarf_die_text(entry, DW_AT_linkage_name,      &name, &error) == DW_DLV_OK) ||
+      (dwarf_die_text(entry, DW_AT_MIPS_linkage_name, &name, &error) == DW_DLV_OK))
+  {
+    if ((__cxa_demangle == NULL) ||
+        (strncmp(name, "_Z", 2) != 0) ||
+        (readable = __cxa_demangle(name, NULL, NULL, NULL)) == NULL)
+    {
+      // Strings of DIE point into the string section
+      return InternUnitString(unit, name);
+    }
+
+    result = InternUnitString(unit, readable);
+    free(readable);
+    return result;
+  }
+
+  if (dwarf_die_text(entry, DW_AT_name, &name, &error) == DW_DLV_OK)
+  {
+    // C function or a name without linkage
+    return InternUnitString(unit, name);
+  }
+
+  result = NULL;
+
+  // Inlined and out-of-line instances refer to the abstract one, definitions refer to declarations
+
+  if ((depth > 0) &&
+      ((dwarf_attr(entry, DW_AT_abstract_origin, &attribute, &error) == DW_DLV_OK) ||
+       (dwarf_attr(entry, DW_AT_specification,   &attribute, &error) == DW_DLV_OK)))
+  {
+    if ((dwarf_global_formref(attribute, &offset, &error)            == DW_DLV_OK) &&
+        (dwarf_offdie_b(instance, offset, 1, &origin, &error) == DW_DLV_OK))
+    {
+      result = GetFunctionName(unit, instance, origin, depth - 1);
+      dwarf_dealloc(instance, origin, DW_DLA_DIE);
+    }
+
+    dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+  }
+
+  return result;
+}
+
+static Dwarf_Unsigned GetAttributeValue(struct DebugUnit* unit, Dwarf_Debug instance, Dwarf_Die entry, Dwarf_Half code)
+{
+  Dwarf_Error error;
+  Dwarf_Unsigned value;
+  Dwarf_Attribute attribute;
+
+  value = 0;
+
+  if (dwarf_attr(entry, code, &attribute, &error) == DW_DLV_OK)
+  {
+    dwarf_formudata(attribute, &value, &error);
+    dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+  }
+
+  return value;
+}
+
+static uint32_t GetCallFile(struct DebugUnit* unit, struct SourceTable* source, struct FrameList* list, Dwarf_Unsigned number)
+{
+  uint32_t* pointer;
+  const char** files;
+  Dwarf_Signed index;
+
+  // Call sites use the same file numbers as the line program, most of files are already mapped
+
+  if ((number >= *list->number) &&
+      (pointer = (uint32_t*)realloc(*list->map, (number + 1) * sizeof(uint32_t))))
+  {
+    memset(pointer + *list->number, 0, (number + 1 - *list->number) * sizeof(uint32_t));
+    *list->map    = pointer;
+    *list->number = number + 1;
+  }
+
+  // DWARF 5 numbers files from 0, previous versions from 1
+
+  index = (list->version >= 5) ? (Dwarf_Signed)number : (Dwarf_Signed)number - 1;
+
+  if ((number < *list->number) &&
+      ((*list->map)[number] == 0) &&
+      (index >= 0) &&
+      (index <  list->count) &&
+      (files = (const char**)realloc(source->files, (source->number + 2) * sizeof(char*))))
+  {
+    source->files = files;
+
+    if (source->files[source->number] = InternUnitString(unit, list->files[index]))
+    {
+      source->number ++;
+      (*list->map)[number] = source->number;
+    }
+  }
+
+  return
+    (number < *list->number)   &&
+    ((*list->map)[number] != 0) ?
+    (*list->map)[number] - 1    :
+    UINT32_MAX;
+}
+
+static void CollectSourceFrames(struct DebugUnit* unit, Dwarf_Debug instance, struct SourceTable* source, struct FrameList* list, Dwarf_Die entry, size_t first, size_t last)
+{
+  int result;
+  size_t start;
+  size_t parent;
+
+  Dwarf_Die current;
+  Dwarf_Die previous;
+
+  Dwarf_Half tag;
+  Dwarf_Error error;
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
+  const char* name;
+  const char** labels;
+  struct SourceFrame* frame;
+  struct DebugRange* range;
+
+  if (dwarf_child(entry, &current, &error) == DW_DLV_OK)
+  {
+    do
+    {
+      tag = 0;
+      dwarf_tag(current, &tag, &error);
+
+      if ((tag == DW_TAG_subprogram) ||
+          (tag == DW_TAG_inlined_subroutine))
+      {
+        start = list->length;
+        list->ranges.length = 0;
+
+        if (CollectRanges(unit, instance, current, 0, &list->ranges) != 0)
+        {
+          name   = GetFunctionName(unit, instance, current, 4);
+          file   = (tag == DW_TAG_inlined_subroutine) ? GetCallFile(unit, source, list, GetAttributeValue(unit, instance, current, DW_AT_call_file)) : UINT32_MAX;
+          line   = (tag == DW_TAG_inlined_subroutine) ? GetAttributeValue(unit, instance, current, DW_AT_call_line)   : 0;
+          column = (tag == DW_TAG_inlined_subroutine) ? GetAttributeValue(unit, instance, current, DW_AT_call_column) : 0;
+
+          for (range = list->ranges.data; range < list->ranges.data + list->ranges.length; range ++)
+          {
+            if ((list->length == list->size) &&
+                (labels = (const char**)realloc(list->labels, (list->size + 1024) * sizeof(char*))))
+            {
+              // Labels are never shorter than frames
+              list->labels = labels;
+
+              if (frame = (struct SourceFrame*)realloc(list->data, (list->size + 1024) * sizeof(struct SourceFrame)))
+              {
+                list->data  = frame;
+                list->size += 1024;
+              }
+            }
+
+            if (list->length == list->size)
+            {
+              // Out of memory
+              break;
+            }
+
+            // Enclosing frame is the range of the outer function which covers the start
+
+            for (parent = first; (parent < last) && ((range->low < list->data[parent].low) || (range->low >= list->data[parent].high)); parent ++);
+
+            frame         = list->data + list->length;
+            frame->low    = range->low;
+            frame->high   = range->high;
+            frame->parent = (parent < last) ? parent : UINT32_MAX;
+            frame->number = list->length;
+            frame->name   = UINT32_MAX;
+            frame->file   = file;
+            frame->line   = line;
+            frame->column = column;
+
+            list->labels[list->length] = name;
+            list->length ++;
+          }
+
+          // Inlined subroutines could be nested into any function
+
+          CollectSourceFrames(unit, instance, source, list, current, start, list->length);
+        }
+      }
+      else if ((tag == DW_TAG_lexical_block)  ||
+               (tag == DW_TAG_namespace)      ||
+               (tag == DW_TAG_class_type)     ||
+               (tag == DW_TAG_structure_type) ||
+               (tag == DW_TAG_union_type))
+      {
+        // Blocks and scopes don't make frames, but could contain them
+        CollectSourceFrames(unit, instance, source, list, current, first, last);
+      }
+
+#ifndef DW_LIBDWARF_VERSION
+      previous = current;
+      result   = dwarf_siblingof(instance, previous, &current, &error);
+#else
+      previous = current;
+      result   = dwarf_siblingof_b(instance, previous, 1, &current, &error);
+#endif
+
+      dwarf_dealloc(instance, previous, DW_DLA_DIE);
+    }
+    while (result == DW_DLV_OK);
+  }
+}
+
+static char* GetAttributeString(Dwarf_Debug instance, Dwarf_Die entry, Dwarf_Half code)
+{
+  char* value;
+  Dwarf_Error error;
+  Dwarf_Attribute attribute;
+
+  value = NULL;
+
+  if (dwarf_attr(entry, code, &attribute, &error) == DW_DLV_OK)
+  {
+    // String belongs to the section, it's valid until the instance is finished
+    if (dwarf_formstring(attribute, &value, &error) != DW_DLV_OK)
+      value = NULL;
+
+    dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+  }
+
+  return value;
+}
+
+static int GetSplitSignature(Dwarf_Debug instance, Dwarf_Die entry, Dwarf_Sig8* signature)
+{
+  int result;
+  Dwarf_Half version;
+  Dwarf_Half length;
+  Dwarf_Half size;
+  Dwarf_Half extension;
+  Dwarf_Bool information;
+  Dwarf_Bool split;
+  Dwarf_Sig8* pointer;
+  Dwarf_Off offset;
+  Dwarf_Unsigned total;
+  Dwarf_Error error;
+  Dwarf_Attribute attribute;
+
+  // DWARF 5 keeps ID of the split unit in the header of skeleton, GNU extension of DWARF 4 in the attribute
+
+  if ((dwarf_cu_header_basics(entry, &version, &information, &split, &length, &size, &extension, &pointer, &offset, &total, &error) == DW_DLV_OK) &&
+      (version >= 5) &&
+      (pointer != NULL))
+  {
+    *signature = *pointer;
+    return 1;
+  }
+
+  result = DW_DLV_NO_ENTRY;
+
+  if (dwarf_attr(entry, DW_AT_GNU_dwo_id, &attribute, &error) == DW_DLV_OK)
+  {
+    result = dwarf_formsig8_const(attribute, signature, &error);
+    dwarf_dealloc(instance, attribute, DW_DLA_ATTR);
+  }
+
+  return result == DW_DLV_OK;
+}
+
+static void CloseSplitUnit(struct SplitUnit* split)
+{
+  if (split->entry != NULL)
+    dwarf_dealloc(split->instance, split->entry, DW_DLA_DIE);
+
+  // Instance of the package is kept by its owner
+
+  if ((split->instance != NULL) &&
+      (split->handle   >= 0))
+  {
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_finish(split->instance, NULL);
+#else
+    dwarf_finish(split->instance);
+#endif
+  }
+
+  elf_end(split->module);
+  close(split->handle);
+
+  split->entry    = NULL;
+  split->instance = NULL;
+  split->module   = NULL;
+  split->handle   = -1;
+}
+
+static int OpenSplitFile(struct SplitUnit* split, Dwarf_Debug instance, const char* path, Dwarf_Sig8* signature)
+{
+  Dwarf_Error error;
+
+  // Sections are mapped and read only when they are required, so a package gives only units hit by lookups
+
+  split->handle = open(path, O_RDONLY);
+  split->module = (split->handle >= 0) ? elf_begin(split->handle, ELF_C_READ_MMAP, NULL) : NULL;
+
+  if (split->module != NULL)
+  {
+    // Result does not matter
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_elf_init(split->module, DW_DLC_READ, NULL, NULL, &split->instance, &error);
+#else
+    dwarf_init_b(split->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &split->instance, &error);
+#endif
+  }
+
+  // Addresses and ranges of split unit are kept by the skeleton's file
+
+  if ((split->instance != NULL) &&
+      (dwarf_set_tied_dbg(split->instance, instance, &error) == DW_DLV_OK) &&
+      (dwarf_die_from_hash_signature(split->instance, signature, "cu", &split->entry, &error) == DW_DLV_OK))
+    return 1;
+
+  CloseSplitUnit(split);
+  return 0;
+}
+
+static int OpenSplitPackage(struct SplitPackage* package, Dwarf_Debug instance, const char* path)
+{
+  Dwarf_Error error;
+
+  // Package is opened by the first skeleton unit and tied to the instance, it is not looked up again when missing
+
+  if ((package->instance != NULL) ||
+      (package->missing  != 0))
+    return package->instance != NULL;
+
+  package->handle = open(path, O_RDONLY);
+  package->module = (package->handle >= 0) ? elf_begin(package->handle, ELF_C_READ_MMAP, NULL) : NULL;
+
+  if (package->module != NULL)
+  {
+    // Result does not matter
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_elf_init(package->module, DW_DLC_READ, NULL, NULL, &package->instance, &error);
+#else
+    dwarf_init_b(package->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &package->instance, &error);
+#endif
+  }
+
+  if ((package->instance != NULL) &&
+      (dwarf_set_tied_dbg(package->instance, instance, &error) == DW_DLV_OK))
+    return 1;
+
+  CloseSplitPackage(package);
+  package->missing = 1;
+  return 0;
+}
+
+static int OpenSplitUnit(struct DebugUnit* unit, Dwarf_Debug instance, struct SplitPackage* package, Dwarf_Die entry, struct SplitUnit* split)
+{
+  char* name;
+  char* folder;
+  Dwarf_Error error;
+  Dwarf_Sig8 signature;
+  char path[PATH_MAX];
+
+  // Skeleton unit has ranges and line program only, functions and inlined subroutines are in .dwo or .dwp
+  // https://gcc.gnu.org/wiki/DebugFission
+
+  split->handle   = -1;
+  split->module   = NULL;
+  split->instance = NULL;
+  split->entry    = NULL;
+
+  if (((name = GetAttributeString(instance, entry, DW_AT_dwo_name))     == NULL) &&
+      ((name = GetAttributeString(instance, entry, DW_AT_GNU_dwo_name)) == NULL) ||
+      (GetSplitSignature(instance, entry, &signature) == 0))
+  {
+    // Not a skeleton
+    return 0;
+  }
+
+  // Package made by dwp is placed next to the module, separated objects are referred relatively to the compilation directory
+
+  if ((snprintf(path, PATH_MAX, "%s.dwp", unit->name) < PATH_MAX) &&
+      (OpenSplitPackage(package, instance, path) != 0) &&
+      (dwarf_die_from_hash_signature(package->instance, &signature, "cu", &split->entry, &error) == DW_DLV_OK))
+  {
+    // Unit of the package, its instance is kept for next tables
+    split->instance = package->instance;
+    return 1;
+  }
+
+  if ((*name != '/') &&
+      (folder = GetAttributeString(instance, entry, DW_AT_comp_dir)))
+    snprintf(path, PATH_MAX, "%s/%s", folder, name);
+  else
+    snprintf(path, PATH_MAX, "%s", name);
+
+  return OpenSplitFile(split, instance, path, &signature);
+}
+
+static void BuildSourceFrames(struct DebugUnit* unit, Dwarf_Debug instance, struct SplitPackage* package, struct SourceTable* source, Dwarf_Die entry, uint32_t** map, size_t* size)
+{
+  size_t number;
+  size_t count;
+  uint32_t* order;
+  const char** names;
+  const char** label;
+  Dwarf_Half dummy;
+  Dwarf_Error error;
+  Dwarf_Debug owner;
+  struct FrameList list;
+  struct SplitUnit split;
+  struct SourceFrame* frame;
+
+  order = NULL;
+  names = NULL;
+  owner = instance;
+
+  memset(&list, 0, sizeof(struct FrameList));
+
+  list.map    = map;
+  list.number = size;
+
+#ifdef DW_LIBDWARF_VERSION
+  dwarf_get_version_of_die(entry, &list.version, &dummy);
+#endif
+
+  if ((OpenSplitUnit(unit, instance, package, entry, &split) != 0) &&
+      (dwarf_srcfiles(split.entry, &list.files, &list.count, &error) == DW_DLV_OK))
+  {
+    // Split unit could have own file table for call sites, otherwise it uses the skeleton's one
+    owner = split.instance;
+  }
+  else if (dwarf_srcfiles(entry, &list.files, &list.count, &error) != DW_DLV_OK)
+  {
+    // Call sites could not be resolved
+    list.files = NULL;
+    list.count = 0;
+  }
+
+  if (split.entry != NULL)
+    CollectSourceFrames(unit, split.instance, source, &list, split.entry, 0, 0);
+  else
+    CollectSourceFrames(unit, instance, source, &list, entry, 0, 0);
+
+  if ((list.length != 0) &&
+      (list.labels != NULL) &&
+      (order = (uint32_t*)malloc(list.length * sizeof(uint32_t))) &&
+      (names = (const char**)malloc(list.length * sizeof(char*))))
+  {
+    // Sort frames by address and fix references to enclosing ones
+
+    qsort(list.data, list.length, sizeof(struct SourceFrame), CompareFrames);
+
+    for (number = 0; number < list.length; number ++)
+      order[list.data[number].number] = number;
+
+    // Function names are deduplicated, frames refer to them by index
+
+    memcpy(names, list.labels, list.length * sizeof(char*));
+    qsort(names, list.length, sizeof(char*), CompareNames);
+
+    for (number = 0, count = 0; number < list.length; number ++)
+    {
+      if ((names[number] != NULL) &&
+          ((count == 0) || (names[count - 1] != names[number])))
+        names[count ++] = names[number];
+    }
+
+    for (frame = list.data; frame < list.data + list.length; frame ++)
+    {
+      label         = (list.labels[frame->number] != NULL) ? (const char**)bsearch(list.labels + frame->number, names, count, sizeof(char*), CompareNames) : NULL;
+      frame->name   = (label != NULL) ? label - names : UINT32_MAX;
+      frame->parent = (frame->parent != UINT32_MAX) ? order[frame->parent] : UINT32_MAX;
+      frame->parent = (frame->parent < frame - list.data) ? frame->parent : UINT32_MAX;
+    }
+
+    source->span   = list.length;
+    source->frames = list.data;
+    source->total  = count;
+    source->names  = (const char**)realloc(names, (count + 1) * sizeof(char*)) ? : names;
+    list.data      = NULL;
+  }
+  else
+  {
+    // Nothing found or out of memory
+    free(names);
+  }
+
+  free(order);
+
+  while (list.count > 0)
+  {
+    list.count --;
+    dwarf_dealloc(owner, list.files[list.count], DW_DLA_STRING);
+  }
+
+  if (list.files != NULL)
+  {
+    // File names are allocated by libdwarf
+    dwarf_dealloc(owner, list.files, DW_DLA_LIST);
+  }
+
+  CloseSplitUnit(&split);
+
+  free(list.ranges.data);
+  free(list.labels);
+  free(list.data);
+}
+
+static struct SourceTable* BuildSourceTable(struct DebugUnit* unit, Dwarf_Debug instance, struct SplitPackage* package, Dwarf_Off offset)
+{
+  struct SourceTable* source;
+  struct SourceLine* list;
+  struct SourceLine* last;
+  Dwarf_Line_Context context;
+  Dwarf_Unsigned version;
+  Dwarf_Unsigned value;
+  Dwarf_Signed length;
+  Dwarf_Small count;
+  Dwarf_Error error;
+  Dwarf_Line* limit;
+  Dwarf_Line* line;
+  Dwarf_Die entry;
+  uint32_t* map;
+  size_t number;
+  size_t size;
+  const char** files;
+
+  map  = NULL;
+  size = 0;
+
+  if (source = (struct SourceTable*)calloc(1, sizeof(struct SourceTable)))
+  {
+    // Keep the offset for reference
+    source->offset = offset;
+  }
+
+  if ((source == NULL) ||
+      (dwarf_offdie_b(instance, offset, 1, &entry, &error) != DW_DLV_OK))
+  {
+    // Empty table prevents from further attempts
+    return source;
+  }
+
+  // Build a compact table once, libdwarf's line context is not required after that
+
+  if ((dwarf_srclines_b(entry, &version, &count, &context, &error)        == DW_DLV_OK) &&
+      (dwarf_srclines_from_linecontext(context, &line, &length, &error) == DW_DLV_OK))
+  {
+    list  = (struct SourceLine*)malloc((length + 1) * sizeof(struct SourceLine));
+    limit = line + length;
+    last  = list;
+
+    source->files = (const char**)calloc(length + 1, sizeof(char*));
+
+    while ((list          != NULL) &&
+           (source->files != NULL) &&
+           (line < limit))
+    {
+      if ((dwarf_lineaddr(*line, &last->address, &error) == DW_DLV_OK) &&
+          (last->address < (Dwarf_Addr)-2))
+      {
+        // Skip tombstones of discarded sections (-1 and -2 are used by lld)
+        last->file   = GetSourceFile(unit, instance, source, *line, &map, &size);
+        last->line   = (dwarf_lineno(*line, &value, &error)    == DW_DLV_OK) ? value : 0;
+        last->column = (dwarf_lineoff_b(*line, &value, &error) == DW_DLV_OK) ? value : 0;
+        last ++;
+      }
+
+      line ++;
+    }
+
+    source->length = last - list;
+
+    if ((source->length != 0) &&
+        (source->rows   = (struct SourceRow*)malloc(source->length * sizeof(struct SourceRow))) &&
+        (source->blocks = (struct SourceBlock*)malloc(((source->length + SOURCE_BLOCK_SIZE - 1) / SOURCE_BLOCK_SIZE + 1) * sizeof(struct SourceBlock))))
+    {
+      qsort(list, source->length, sizeof(struct SourceLine), CompareAddresses);
+
+      for (number = 0; number < source->length; number ++)
+      {
+        // Each module is less than 4 GB, so the delta always fits
+        source->rows[number].offset = list[number].address - list[number - number % SOURCE_BLOCK_SIZE].address;
+        source->rows[number].file   = list[number].file;
+        source->rows[number].line   = list[number].line;
+        source->rows[number].column = list[number].column;
+      }
+
+      number        = 0;
+      source->count = (source->length + SOURCE_BLOCK_SIZE - 1) / SOURCE_BLOCK_SIZE;
+      FillSourceBlocks(source, list, &number, 1);
+    }
+    else
+    {
+      free(source->rows);
+      source->rows   = NULL;
+      source->length = 0;
+      source->count  = 0;
+    }
+
+    dwarf_srclines_dealloc_b(context);
+    free(list);
+  }
+
+  // Functions and inlined subroutines could add files of call sites
+
+  BuildSourceFrames(unit, instance, package, source, entry, &map, &size);
+
+  if ((source->files != NULL) &&
+      (files = (const char**)realloc(source->files, (source->number + 1) * sizeof(char*))))
+  {
+    // Shrink the file table to the actual size
+    source->files = files;
+  }
+
+  source->identifiers = RegisterDebugFiles(source->files, source->number);
+
+  dwarf_dealloc(instance, entry, DW_DLA_DIE);
+  free(map);
+
+  return source;
+}
+
+static struct SourceRow* FindSourceRow(struct SourceTable* source, Dwarf_Addr address, Dwarf_Addr* location)
+{
+  size_t index;
+  Dwarf_Addr base;
+  struct SourceRow* row;
+  struct SourceRow* limit;
+
+  // Find the first block which last row is not less than the address
+
+  index = 1;
+
+  while (index <= source->count)
+  {
+    __builtin_prefetch(source->blocks + index * 4);
+    index = index * 2 + (source->blocks[index].limit < address);
+  }
+
+  index >>= __builtin_ffsl(~index);
+
+  if (index == 0)
+  {
+    // Address is beyond the last row
+    return NULL;
+  }
+
+  // The block always contains the row, walk at most SOURCE_BLOCK_SIZE rows
+
+  base  = source->blocks[index].limit - source->blocks[index].offset;
+  row   = source->rows + source->blocks[index].number * SOURCE_BLOCK_SIZE;
+  limit = row + SOURCE_BLOCK_SIZE;
+
+  if (limit > source->rows + source->length)
+  {
+    // The last block could be incomplete
+    limit = source->rows + source->length;
+  }
+
+  while ((row < limit) &&
+         (base + row->offset < address))
+  {
+    // Rows are sorted within the block
+    row ++;
+  }
+
+  *location = base + row->offset;
+  return row;
+}
+
+static struct SourceFrame* FindSourceFrame(struct SourceTable* source, Dwarf_Addr address)
+{
+  size_t low;
+  size_t high;
+  size_t middle;
+  struct SourceFrame* frame;
+
+  // Find the last frame which starts not after the address
+
+  low  = 0;
+  high = source->span;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+
+    if (source->frames[middle].low <= address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  // Innermost frame covering the address is the found one or one of its enclosing frames
+
+  while (low != 0)
+  {
+    frame = source->frames + low - 1;
+
+    if (address < frame->high)
+      return frame;
+
+    // Enclosing frame always goes before, so the walk is finite even for a broken file
+    low = (frame->parent < low - 1) ? frame->parent + 1 : 0;
+  }
+
+  return NULL;
+}
+
+static const char* GetFrameName(struct SourceTable* source, struct SourceFrame* frame)
+{
+  return
+    (frame != NULL) &&
+    (frame->name < source->total) ?
+    source->names[frame->name]    :
+    NULL;
+}
+
+// Symbol resolution
+
+static int CompareSymbols(const void* pointer1, const void* pointer2)
+{
+  struct SymbolEntry* symbol1;
+  struct SymbolEntry* symbol2;
+
+  symbol1 = (struct SymbolEntry*)pointer1;
+  symbol2 = (struct SymbolEntry*)pointer2;
+
+  // Aliases share the address, the one with known size goes first
+
+  return
+    (symbol1->address > symbol2->address) - (symbol1->address < symbol2->address) ?
+    (symbol1->address > symbol2->address) - (symbol1->address < symbol2->address) :
+    (symbol1->size < symbol2->size) - (symbol1->size > symbol2->size);
+}
+
+static void CollectSymbols(struct DebugUnit* unit, Elf* image, struct SymbolTable* list, size_t* size)
+{
+  GElf_Shdr header;
+  Elf_Scn* section;
+  Elf_Data* data;
+  GElf_Sym symbol;
+  struct SymbolEntry* entry;
+  const char* name;
+  size_t number;
+  size_t count;
+
+  section = NULL;
+
+  while (section = elf_nextscn(image, section))
+  {
+    if ((gelf_getshdr(section, &header) == NULL) ||
+        (header.sh_type != SHT_SYMTAB) && (header.sh_type != SHT_DYNSYM) ||
+        (header.sh_entsize == 0) ||
+        (data = elf_getdata(section, NULL)) == NULL)
+    {
+      // Only symbol tables are interesting
+      continue;
+    }
+
+    count = header.sh_size / header.sh_entsize;
+
+    for (number = 0; number < count; number ++)
+    {
+      if ((gelf_getsym(data, number, &symbol) == NULL) ||
+          (GELF_ST_TYPE(symbol.st_info) != STT_FUNC) && (GELF_ST_TYPE(symbol.st_info) != STT_GNU_IFUNC) ||
+          (symbol.st_shndx == SHN_UNDEF) ||
+          (symbol.st_value == 0) ||
+          (name = elf_strptr(image, header.sh_link, symbol.st_name)) == NULL ||
+          (*name == '\0'))
+      {
+        // Skip imports and anonymous entries
+        continue;
+      }
+
+      if ((list->count == *size) &&
+          (entry = (struct SymbolEntry*)realloc(list->entries, (*size + 4096) * sizeof(struct SymbolEntry))))
+      {
+        list->entries = entry;
+        *size        += 4096;
+      }
+
+      if ((list->count < *size) &&
+          (name = InternString(&unit->names, name)))
+      {
+        entry          = list->entries + list->count;
+        entry->address = symbol.st_value;
+        entry->size    = symbol.st_size;
+        entry->name    = name;
+        atomic_init(&entry->readable, 0);
+        list->count ++;
+      }
+    }
+  }
+}
+
+static void CollectCompressedSymbols(struct DebugUnit* unit, Elf* image, struct SymbolTable* list, size_t* size)
+{
+#if __has_include(<lzma.h>)
+  GElf_Shdr header;
+  Elf_Scn* section;
+  Elf_Data* data;
+  Elf* embedding;
+  lzma_stream stream;
+  lzma_ret result;
+  uint8_t* buffer;
+  uint8_t* pointer;
+  size_t length;
+
+  // MiniDebugInfo keeps .symtab of stripped binary in xz-compressed ELF
+  // https://sourceware.org/gdb/current/onlinedocs/gdb.html/MiniDebugInfo.html
+
+  if ((lzma_stream_decoder == NULL) ||
+      (section = GetELFSection(image, ".gnu_debugdata", &header)) == NULL ||
+      (data    = elf_getdata(section, NULL)) == NULL)
+  {
+    // Nothing to decompress or no way to do it
+    return;
+  }
+
+  memset(&stream, 0, sizeof(lzma_stream));
+
+  if (lzma_stream_decoder(&stream, UINT64_MAX, 0) != LZMA_OK)
+  {
+    // Decoder could not be allocated
+    return;
+  }
+
+  buffer  = NULL;
+  length  = data->d_size * 4;
+  result  = LZMA_OK;
+
+  stream.next_in  = (const uint8_t*)data->d_buf;
+  stream.avail_in = data->d_size;
+
+  while ((result == LZMA_OK) &&
+         (pointer = (uint8_t*)realloc(buffer, length)))
+  {
+    buffer            = pointer;
+    stream.next_out   = buffer + stream.total_out;
+    stream.avail_out  = length - stream.total_out;
+    result            = lzma_code(&stream, LZMA_FINISH);
+    length           *= 2;
+  }
+
+  if ((result    == LZMA_STREAM_END) &&
+      (embedding  = elf_memory((char*)buffer, stream.total_out)))
+  {
+    CollectSymbols(unit, embedding, list, size);
+    elf_end(embedding);
+  }
+
+  lzma_end(&stream);
+  free(buffer);
+#endif
+}
+
+static struct SymbolTable* BuildSymbolTable(struct DebugUnit* unit)
+{
+  int handle;
+  Elf* image;
+  size_t size;
+  size_t number;
+  size_t count;
+  uint8_t* identifier;
+  struct SymbolTable* list;
+  struct SymbolEntry* entries;
+
+  if ((list = (struct SymbolTable*)calloc(1, sizeof(struct SymbolTable))) == NULL)
+  {
+    // Out of memory
+    return NULL;
+  }
+
+  // The binary itself is opened again, the unit could keep a separated debug file or nothing at all
+
+  size   = 0;
+  image  = NULL;
+  handle = open(unit->name, O_RDONLY);
+
+  if ((handle >= 0) &&
+      (image  = elf_begin(handle, ELF_C_READ, NULL)) &&
+      ((unit->size == 0) ||
+       (identifier = GetBuildID(image, &count)) &&
+       (count == unit->size) &&
+       (memcmp(identifier, unit->identifier, count) == 0)))
+  {
+    // File on disk still describes the module
+    CollectSymbols(unit, image, list, &size);
+    CollectCompressedSymbols(unit, image, list, &size);
+  }
+
+  elf_end(image);
+  close(handle);
+
+  if (unit->module != NULL)
+  {
+    // Separated debug file has the full .symtab
+    CollectSymbols(unit, unit->module, list, &size);
+  }
+
+  if (list->count != 0)
+  {
+    qsort(list->entries, list->count, sizeof(struct SymbolEntry), CompareSymbols);
+
+    for (number = 1, count = 1; number < list->count; number ++)
+    {
+      if (list->entries[number].address != list->entries[count - 1].address)
+      {
+        // Keep one symbol per address
+        list->entries[count ++] = list->entries[number];
+      }
+    }
+
+    list->count = count;
+
+    if (entries = (struct SymbolEntry*)realloc(list->entries, list->count * sizeof(struct SymbolEntry)))
+    {
+      // Shrink the table to the actual size
+      list->entries = entries;
+    }
+  }
+
+  return list;
+}
+
+static struct SymbolEntry* FindSymbolEntry(struct SymbolTable* symbols, Dwarf_Addr address)
+{
+  size_t low;
+  size_t high;
+  size_t middle;
+  struct SymbolEntry* entry;
+
+  low  = 0;
+  high = symbols->count;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+
+    if (symbols->entries[middle].address <= address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low == 0)
+  {
+    // Address is before the first function
+    return NULL;
+  }
+
+  entry = symbols->entries + low - 1;
+
+  return
+    (entry->size == 0) ||
+    (address < entry->address + entry->size) ?
+    entry                                    :
+    NULL;
+}
+
+static const char* GetReadableName(struct DebugUnit* unit, struct SymbolEntry* entry, int lock)
+{
+  char* name;
+  const char* value;
+
+  // Demangled names are computed once and interned, so they outlive eviction of the table
+
+  if (value = (const char*)atomic_load_explicit(&entry->readable, memory_order_acquire))
+    return value;
+
+  if ((lock         == DEBUG_GET_SIGNAL_SAFE) ||
+      (__cxa_demangle == NULL) ||
+      (strncmp(entry->name, "_Z", 2) != 0) ||
+      (name = __cxa_demangle(entry->name, NULL, NULL, NULL)) == NULL)
+  {
+    // Demangling requires heap, or name is not mangled at all
+    return entry->name;
+  }
+
+  value = entry->name;
+
+  if (LockDebugUnit(unit, lock) != 0)
+  {
+    if (value = InternString(&unit->names, name))
+      atomic_store_explicit(&entry->readable, (uintptr_t)value, memory_order_release);
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  free(name);
+  return (value != NULL) ? value : entry->name;
+}
+
+static struct DebugIndex* GetDebugIndex(struct DebugUnit* unit, int lock)
+{
+  uint64_t start;
+  struct DebugIndex* index;
+
+  // Index is published once, only its construction is serialized
+
+  index = (struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_acquire);
+
+  if (index != NULL)
+  {
+    // Hits are counted by tables only
+    return index;
+  }
+
+  if ((unit->instance == NULL) &&
+      (atomic_load_explicit(&unit->evicted, memory_order_relaxed) == 0))
+  {
+    // Nothing to build from, debug information might be brought by debuginfod later
+    RequestDebugFetch(unit, lock);
+    return NULL;
+  }
+
+  if (LockDebugUnit(unit, lock) != 0)
+  {
+    if (atomic_load_explicit(&unit->evicted, memory_order_relaxed) != 0)
+    {
+      // DWARF or persistent index has been released by eviction
+      atomic_store_explicit(&unit->evicted, 0, memory_order_relaxed);
+
+      start = GetDebugTime();
+      OpenDebugUnit(unit, NULL);
+      CountDebugTime(unit, DEBUG_TIER_OPEN, start);
+    }
+
+    index = (struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_relaxed);
+
+    if ((index == NULL) &&
+        (unit->instance != NULL))
+    {
+      start = GetDebugTime();
+      index = BuildDebugIndex(unit);
+      CountDebugTime(unit, DEBUG_TIER_INDEX, start);
+      CountDebugEvent(unit, DEBUG_COUNTER_MISSES, 1);
+
+      if (index != NULL)
+      {
+        // Publish complete index
+        atomic_fetch_add_explicit(&usage, GetDebugIndexWeight(index), memory_order_relaxed);
+        atomic_store_explicit(&unit->index, (uintptr_t)index, memory_order_release);
+        ClearMissCache(unit);
+      }
+    }
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  return index;
+}
+
+static struct SourceTable* GetSourceTable(struct DebugUnit* unit, struct DebugIndex* index, struct SourceSlot* slot, int lock)
+{
+  uint64_t start;
+  struct SourceTable* source;
+
+  source = (struct SourceTable*)atomic_load_explicit(&slot->table, memory_order_acquire);
+
+  if (source != NULL)
+  {
+    CountDebugEvent(unit, DEBUG_COUNTER_HITS, 1);
+    return source;
+  }
+
+  if (LockDebugUnit(unit, lock) != 0)
+  {
+    source = (struct SourceTable*)atomic_load_explicit(&slot->table, memory_order_relaxed);
+
+    if ((source == NULL) &&
+        (unit->instance != NULL) &&
+        (atomic_load_explicit(&unit->index, memory_order_relaxed) == (uintptr_t)index))
+    {
+      start  = GetDebugTime();
+      source = BuildSourceTable(unit, unit->instance, &unit->package, slot->offset);
+      CountDebugTime(unit, DEBUG_TIER_SOURCE, start);
+      CountDebugEvent(unit, DEBUG_COUNTER_MISSES, 1);
+
+      if (source != NULL)
+      {
+        // Publish complete table, an index retired by eviction never gets new tables
+        atomic_fetch_add_explicit(&usage, GetSourceTableWeight(source, 0), memory_order_relaxed);
+        atomic_store_explicit(&slot->table, (uintptr_t)source, memory_order_release);
+        ClearMissCache(unit);
+      }
+    }
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  return source;
+}
+
+static struct SymbolTable* GetSymbolTable(struct DebugUnit* unit, int lock)
+{
+  uint64_t start;
+  struct SymbolTable* symbols;
+
+  symbols = (struct SymbolTable*)atomic_load_explicit(&unit->symbols, memory_order_acquire);
+
+  if ((symbols == NULL) &&
+      (LockDebugUnit(unit, lock) != 0))
+  {
+    symbols = (struct SymbolTable*)atomic_load_explicit(&unit->symbols, memory_order_relaxed);
+
+    if (symbols == NULL)
+    {
+      start   = GetDebugTime();
+      symbols = BuildSymbolTable(unit);
+      CountDebugTime(unit, DEBUG_TIER_SYMBOLS, start);
+
+      if (symbols != NULL)
+      {
+        // Publish complete table
+        atomic_fetch_add_explicit(&usage, GetSymbolTableWeight(symbols), memory_order_relaxed);
+        atomic_store_explicit(&unit->symbols, (uintptr_t)symbols, memory_order_release);
+      }
+    }
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  return symbols;
+}
+
+static int ResolveDebugAddress(struct DebugUnit* unit, struct DebugIndex* index, uintptr_t base, uintptr_t address, struct DebugRange** range, struct SourceTable** source, struct DebugSourceInformation* buffer, int lock)
+{
+  Dwarf_Addr location;
+  struct SourceRow* row;
+
+  // Range and source are kept between calls for neighbouring addresses
+
+  address -= base;
+
+  buffer->instance = unit->instance;
+  buffer->path     = NULL;
+  buffer->file     = 0;
+  buffer->function = NULL;
+  buffer->line     = 0;
+  buffer->column   = 0;
+  buffer->address  = 0;
+
+  if ((*range == NULL) ||
+      (address <  (*range)->low) ||
+      (address >= (*range)->high))
+  {
+    *source = NULL;
+    *range  = FindDebugRange(index, address);
+  }
+
+  if ((*range  != NULL) &&
+      (*source == NULL))
+  {
+    TouchDebugStamp(&index->slots[(*range)->number].stamp);
+
+    if ((*source = GetSourceTable(unit, index, index->slots + (*range)->number, lock)) == NULL)
+    {
+      // The table is being built by another thread
+      return 0;
+    }
+  }
+
+  if ((*source != NULL) &&
+      (row = FindSourceRow(*source, address, &location)))
+  {
+    buffer->address  = location + base;
+    buffer->path     = (row->file < (*source)->number) ? (*source)->files[row->file] : NULL;
+    buffer->file     = (row->file < (*source)->number) && ((*source)->identifiers != NULL) ? (*source)->identifiers[row->file] : 0;
+    buffer->function = GetFrameName(*source, FindSourceFrame(*source, address));
+    buffer->line     = row->line;
+    buffer->column   = row->column;
+    return 1;
+  }
+
+  UpdateMissCache(unit, address);
+  return 0;
+}
+
+// Memory budget
+
+static int CompareCandidates(const void* value1, const void* value2)
+{
+  const struct DebugCandidate* candidate1;
+  const struct DebugCandidate* candidate2;
+  unsigned int current;
+
+  // The oldest first, tables of compilation units go before their units
+
+  candidate1 = (const struct DebugCandidate*)value1;
+  candidate2 = (const struct DebugCandidate*)value2;
+  current    = atomic_load_explicit(&tick, memory_order_relaxed);
+
+  return
+    (current - candidate1->stamp) > (current - candidate2->stamp) ? -1 :
+    (current - candidate1->stamp) < (current - candidate2->stamp) ?  1 :
+    (candidate1->number < candidate2->number) ? -1 :
+    (candidate1->number > candidate2->number);
+}
+
+static void EvictDebugCache(size_t goal, int lock)
+{
+  size_t size;
+  size_t length;
+  size_t number;
+  struct DebugUnit* unit;
+  struct DebugIndex* index;
+  struct DebugCandidate* data;
+  struct DebugCandidate* other;
+  struct DebugCandidate* candidate;
+  struct SourceTable* source;
+
+  // Called with trimmer held, candidates are collected without locks and checked again under lock of the unit
+
+  data   = NULL;
+  size   = 0;
+  length = 0;
+
+  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire); unit != NULL; unit = (struct DebugUnit*)unit->next)
+  {
+    // Tables of a persistent index keep rows, blocks and frames in its mapping and could not be rebuilt
+    // without DWARF, so the mapped index is evicted only as a whole with its unit
+
+    index  = (struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_acquire);
+    number = ((index != NULL) && (index->mapping == NULL)) ? index->count : 0;
+
+    if (length + number + 1 > size)
+    {
+      size = (length + number + 1) * 2;
+
+      if ((other = (struct DebugCandidate*)realloc(data, size * sizeof(struct DebugCandidate))) == NULL)
+        break;
+
+      data = other;
+    }
+
+    while (number > 0)
+    {
+      number --;
+
+      if (atomic_load_explicit(&index->slots[number].table, memory_order_relaxed) != 0)
+      {
+        candidate         = data + length ++;
+        candidate->unit   = unit;
+        candidate->index  = index;
+        candidate->number = number;
+        candidate->stamp  = atomic_load_explicit(&index->slots[number].stamp, memory_order_relaxed);
+      }
+    }
+
+    candidate         = data + length ++;
+    candidate->unit   = unit;
+    candidate->index  = NULL;
+    candidate->number = SIZE_MAX;
+    candidate->stamp  = atomic_load_explicit(&unit->stamp, memory_order_relaxed);
+  }
+
+  // Objects touched since now are newer than any candidate
+
+  atomic_fetch_add_explicit(&tick, 1, memory_order_relaxed);
+  qsort(data, length, sizeof(struct DebugCandidate), CompareCandidates);
+
+  for (candidate = data; (candidate < data + length) && (atomic_load_explicit(&usage, memory_order_relaxed) > goal); candidate ++)
+  {
+    unit = candidate->unit;
+
+    if (LockDebugUnit(unit, lock) == 0)
+    {
+      // Unit is busy, it's not the oldest one anyway
+      continue;
+    }
+
+    if (candidate->index == NULL)
+    {
+      if ((unit->instance != NULL) ||
+          (atomic_load_explicit(&unit->index,   memory_order_relaxed) != 0) ||
+          (atomic_load_explicit(&unit->symbols, memory_order_relaxed) != 0))
+      {
+        EvictDebugUnit(unit);
+        CountDebugEvent(unit, DEBUG_COUNTER_EVICTIONS, 1);
+      }
+    }
+    else if ((atomic_load_explicit(&unit->index, memory_order_relaxed) == (uintptr_t)candidate->index) &&
+             (ReserveDebugRetiree() != 0) &&
+             (source = (struct SourceTable*)atomic_exchange_explicit(&candidate->index->slots[candidate->number].table, 0, memory_order_acq_rel)))
+    {
+      RetireDebugObject(DEBUG_RETIRE_SOURCE, source, GetSourceTableWeight(source, 0));
+      CountDebugEvent(unit, DEBUG_COUNTER_EVICTIONS, 1);
+    }
+
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  free(data);
+}
+
+static void CheckDebugCacheBudget(int lock)
+{
+  size_t limit;
+
+  // Eviction is done by the thread which exceeded the budget, only when nobody else does it,
+  // the cache is trimmed a bit below the budget to not evict on every lookup
+
+  limit = atomic_load_explicit(&budget, memory_order_relaxed);
+
+  if ((lock  == DEBUG_GET_LOCK_WAIT) &&
+      (limit != 0) &&
+      (atomic_load_explicit(&usage, memory_order_relaxed) > limit) &&
+      (pthread_mutex_trylock(&trimmer) == 0))
+  {
+    EvictDebugCache(limit - limit / 8, DEBUG_GET_LOCK_DONT_WAIT);
+    ReclaimDebugCache();
+    pthread_mutex_unlock(&trimmer);
+  }
+}
+
+void SetDebugCacheLimit(size_t size)
+{
+  atomic_store_explicit(&budget, size, memory_order_relaxed);
+}
+
+void TrimDebugCache(size_t size)
+{
+  pthread_mutex_lock(&trimmer);
+  EvictDebugCache(size, DEBUG_GET_LOCK_WAIT);
+  ReclaimDebugCache();
+  pthread_mutex_unlock(&trimmer);
+}
+
+void GetDebugCacheStatistics(struct DebugCacheStatistics* statistics)
+{
+  struct DebugUnit* unit;
+
+  memset(statistics, 0, sizeof(struct DebugCacheStatistics));
+
+  statistics->usage = atomic_load_explicit(&usage, memory_order_relaxed);
+  statistics->limit = atomic_load_explicit(&budget, memory_order_relaxed);
+
+  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire); unit != NULL; unit = (struct DebugUnit*)unit->next)
+    ReadDebugCounters(unit, &statistics->counters);
+}
+
+size_t GetDebugUnitStatistics(struct DebugUnitStatistics* list, size_t count)
+{
+  size_t number;
+  unsigned int current;
+  struct DebugUnit* unit;
+  struct DebugIndex* index;
+  struct SymbolTable* symbols;
+
+  // Usage of a unit is estimated by its tables, they are not released meanwhile
+
+  number  = 0;
+  current = EnterDebugCache();
+
+  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire); unit != NULL; unit = (struct DebugUnit*)unit->next, number ++)
+  {
+    if (number < count)
+    {
+      index   = (struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_acquire);
+      symbols = (struct SymbolTable*)atomic_load_explicit(&unit->symbols, memory_order_acquire);
+
+      memset(list + number, 0, sizeof(struct DebugUnitStatistics));
+
+      list[number].name   = unit->name;
+      list[number].usage  = unit->weight;
+      list[number].usage += (index   != NULL) ? GetDebugIndexWeight(index)    : 0;
+      list[number].usage += (symbols != NULL) ? GetSymbolTableWeight(symbols) : 0;
+
+      ReadDebugCounters(unit, &list[number].counters);
+    }
+  }
+
+  LeaveDebugCache(current);
+  return number;
+}
+
+// Frame cache
+
+static size_t GetFrameSlot(uintptr_t address)
+{
+  return ((uint64_t)address * 0x9e3779b97f4a7c15ULL) >> (64 - DEBUG_FRAME_ORDER);
+}
+
+static unsigned int GetFrameVersion(int lock)
+{
+  long current;
+  struct timespec time;
+
+  // Unloading of modules is noticed by a refresh of the module map, which is not async-signal-safe
+  // and takes the lock of the loader, so it's done once per period by one thread,
+  // or at once when the loader is changing the list of modules
+
+  if (lock != DEBUG_GET_SIGNAL_SAFE)
+  {
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+    current = (time.tv_sec * 1000 + time.tv_nsec / 1000000) / DEBUG_FRAME_PERIOD;
+
+    if ((*(volatile int*)&_r_debug.r_state != RT_CONSISTENT) ||
+        (atomic_load_explicit(&moment, memory_order_relaxed) != current) &&
+        (atomic_exchange_explicit(&moment, current, memory_order_relaxed) != current))
+      RefreshDebugArena(lock);
+  }
+
+  return atomic_load_explicit(&validity, memory_order_acquire);
+}
+
+static int FindFrameRecord(uintptr_t address, unsigned int version, struct DebugFrameRecord* record)
+{
+  size_t number;
+  size_t position;
+  unsigned int sequence;
+  struct DebugFrameSlot* slot;
+
+  // Readers never write and never wait, so the cache could be used in signal handlers
+
+  position = GetFrameSlot(address);
+
+  for (number = 0; number < DEBUG_FRAME_PROBES; number ++)
+  {
+    slot     = frames + ((position + number) & ((1 << DEBUG_FRAME_ORDER) - 1));
+    sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+    if ((sequence & 1) ||
+        (slot->record.address != address) ||
+        (slot->record.version != version))
+      continue;
+
+    memcpy(record, &slot->record, sizeof(struct DebugFrameRecord));
+    atomic_thread_fence(memory_order_acquire);
+
+    if ((atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence) &&
+        (record->address == address) &&
+        (record->version == version))
+      return 1;
+  }
+
+  return 0;
+}
+
+static void StoreFrameRecord(struct DebugFrameRecord* record)
+{
+  size_t number;
+  size_t position;
+  unsigned int sequence;
+  struct DebugFrameSlot* slot;
+  struct DebugFrameSlot* victim;
+
+  // Writer takes the slot by making its sequence odd, a busy slot is skipped, so writers never wait either
+
+  position = GetFrameSlot(record->address);
+  victim   = frames + position;
+
+  for (number = 0; number < DEBUG_FRAME_PROBES; number ++)
+  {
+    slot = frames + ((position + number) & ((1 << DEBUG_FRAME_ORDER) - 1));
+
+    if ((slot->record.address == 0) ||
+        (slot->record.address == record->address) ||
+        (slot->record.version != record->version))
+    {
+      // Free slot, the same address or a stale record
+      victim = slot;
+      break;
+    }
+  }
+
+  sequence = atomic_load_explicit(&victim->sequence, memory_order_relaxed);
+
+  if ((sequence & 1) ||
+      (!atomic_compare_exchange_strong_explicit(&victim->sequence, &sequence, sequence + 1, memory_order_relaxed, memory_order_relaxed)))
+    return;
+
+  atomic_thread_fence(memory_order_release);
+  memcpy(&victim->record, record, sizeof(struct DebugFrameRecord));
+  atomic_store_explicit(&victim->sequence, sequence + 2, memory_order_release);
+}
+
+static size_t GetFrameDepth(struct SourceTable* source, Dwarf_Addr address)
+{
+  size_t depth;
+  struct SourceFrame* frame;
+
+  // The same walk as the one of GetDebugInformationChain(), bounded by the table in case of a cycle
+
+  frame = FindSourceFrame(source, address);
+
+  for (depth = 1; (frame != NULL) && (depth <= source->span) && (frame->parent < source->span) && ((frame->file != UINT32_MAX) || (frame->line != 0)); depth ++)
+    frame = source->frames + frame->parent;
+
+  return depth;
+}
+
+static void StoreSourceRecord(struct DebugUnit* unit, uintptr_t base, uintptr_t address, unsigned int version, struct DebugSourceInformation* source, size_t depth)
+{
+  struct DebugFrameRecord record;
+
+  memset(&record, 0, sizeof(struct DebugFrameRecord));
+
+  record.version = version;
+  record.flags   = DEBUG_FRAME_SOURCE;
+  record.address = address;
+  record.module  = unit->name;
+  record.base    = base;
+  record.depth   = depth;
+  record.source  = *source;
+
+  StoreFrameRecord(&record);
+}
+
+// Lookup
+
+static struct DebugUnit* FindAddressUnit(uintptr_t address, uintptr_t* base, int lock)
+{
+  struct DebugUnit* unit;
+  struct DebugArena* current;
+  struct DebugSegment* segment;
+
+  // Module is found by a binary search in the module map, dladdr1() data is not required anymore
+
+  if (lock == DEBUG_GET_SIGNAL_SAFE)
+  {
+    // Neither refresh nor loading are async-signal-safe, use only structures prepared before
+    current = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_acquire);
+  }
+  else
+  {
+    // Module map is rebuilt when modules have been loaded or unloaded
+    current = RefreshDebugArena(lock);
+  }
+
+  if ((segment = FindDebugSegment(current, address)) == NULL)
+  {
+    // Address does not belong to any module
+    return NULL;
+  }
+
+  *base = segment->base;
+  unit  = (lock == DEBUG_GET_SIGNAL_SAFE) ?
+    (struct DebugUnit*)atomic_load_explicit(&segment->module->unit, memory_order_acquire) :
+    GetDebugUnit(segment->module, NULL, lock);
+
+  if (unit != NULL)
+  {
+    // Unit is the last candidate of eviction while it's in use
+    TouchDebugStamp(&unit->stamp);
+  }
+
+  return unit;
+}
+
+int GetDebugInformation(Dl_info* information, struct link_map* map, uintptr_t address, struct DebugSourceInformation* buffer, int lock)
+{
+  int result;
+  uintptr_t base;
+  unsigned int current;
+  unsigned int version;
+  struct DebugFrameRecord record;
+  struct DebugUnit* unit;
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct SourceTable* source;
+
+  // Hot addresses are served by the frame cache, tables are not released by eviction while they are in use,
+  // the version is read inside the cache, so records of released tables are never taken
+
+  current = EnterDebugCache();
+  version = GetFrameVersion(lock);
+
+  if (FindFrameRecord(address, version, &record) != 0)
+  {
+    *buffer = record.source;
+    LeaveDebugCache(current);
+    return 1;
+  }
+
+  base    = 0;
+  range   = NULL;
+  source  = NULL;
+  unit    = FindAddressUnit(address, &base, lock);
+  result  =
+    (unit != NULL) &&
+    (address >= base) &&
+    (CheckMissCache(unit, address - base) == 0) &&
+    (index = GetDebugIndex(unit, lock)) &&
+    (ResolveDebugAddress(unit, index, base, address, &range, &source, buffer, lock) != 0);
+
+  if (result != 0)
+  {
+    // Strings of the record stay valid until the version is changed by eviction
+    StoreSourceRecord(unit, base, address, version, buffer, GetFrameDepth(source, address - base));
+  }
+
+  LeaveDebugCache(current);
+  CheckDebugCacheBudget(lock);
+  return result;
+}
+
+int GetDebugInformationChain(uintptr_t address, struct DebugSourceInformation* chain, size_t count, int lock)
+{
+  size_t number;
+  uintptr_t base;
+  struct DebugUnit* unit;
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct SourceTable* source;
+  struct SourceFrame* frame;
+  struct DebugFrameRecord record;
+  unsigned int version;
+  unsigned int current;
+
+  // Records of the frame cache keep only the innermost frame, so they serve addresses without inlined subroutines
+
+  current = EnterDebugCache();
+  version = GetFrameVersion(lock);
+
+  if ((count != 0) &&
+      (FindFrameRecord(address, version, &record) != 0) &&
+      (record.depth == 1))
+  {
+    chain[0] = record.source;
+    LeaveDebugCache(current);
+    return 1;
+  }
+
+  base    = 0;
+  range   = NULL;
+  source  = NULL;
+  unit    = FindAddressUnit(address, &base, lock);
+
+  if ((count == 0) ||
+      (unit  == NULL) ||
+      (address < base) ||
+      (CheckMissCache(unit, address - base) != 0) ||
+      ((index = GetDebugIndex(unit, lock)) == NULL) ||
+      (ResolveDebugAddress(unit, index, base, address, &range, &source, chain, lock) == 0))
+  {
+    // Address could not be resolved
+    LeaveDebugCache(current);
+    CheckDebugCacheBudget(lock);
+    return 0;
+  }
+
+  // The first entry is the innermost inlined subroutine, every next one is its caller
+  // located at the call site, the chain ends at the function which has no call site
+
+  frame = FindSourceFrame(source, address - base);
+
+  for (number = 1; (number < count) && (frame != NULL) && (frame->parent != UINT32_MAX) && ((frame->file != UINT32_MAX) || (frame->line != 0)); number ++)
+  {
+    chain[number].instance = chain[0].instance;
+    chain[number].address  = chain[0].address;
+    chain[number].path     = (frame->file < source->number) ? source->files[frame->file] : NULL;
+    chain[number].file     = (frame->file < source->number) && (source->identifiers != NULL) ? source->identifiers[frame->file] : 0;
+    chain[number].line     = frame->line;
+    chain[number].column   = frame->column;
+
+    frame = source->frames + frame->parent;
+    chain[number].function = GetFrameName(source, frame);
+  }
+
+  // Length of the chain is known only when it's not truncated
+  StoreSourceRecord(unit, base, address, version, chain, (number < count) ? number : 0);
+
+  LeaveDebugCache(current);
+  CheckDebugCacheBudget(lock);
+  return number;
+}
+
+int GetDebugSymbol(uintptr_t address, struct DebugSymbolInformation* buffer, int lock)
+{
+  uintptr_t base;
+  struct DebugUnit* unit;
+  struct SymbolEntry* entry;
+  struct SymbolTable* symbols;
+  unsigned int current;
+
+  current = EnterDebugCache();
+  base    = 0;
+  unit    = FindAddressUnit(address, &base, lock);
+
+  if ((unit    == NULL) ||
+      (address <  base) ||
+      (symbols = GetSymbolTable(unit, lock)) == NULL ||
+      (entry   = FindSymbolEntry(symbols, address - base)) == NULL)
+  {
+    // Address does not belong to any known function
+    LeaveDebugCache(current);
+    CheckDebugCacheBudget(lock);
+    return 0;
+  }
+
+  buffer->name    = GetReadableName(unit, entry, lock);
+  buffer->mangled = entry->name;
+  buffer->address = entry->address + base;
+  buffer->size    = entry->size;
+
+  LeaveDebugCache(current);
+  CheckDebugCacheBudget(lock);
+  return 1;
+}
+
+static void SiftDebugRequest(struct DebugRequest* requests, size_t index, size_t count)
+{
+  size_t child;
+  struct DebugRequest request;
+
+  request = requests[index];
+
+  while ((child = index * 2 + 1) < count)
+  {
+    if ((child + 1 < count) &&
+        (requests[child + 1].address > requests[child].address))
+    {
+      // Take the greater child
+      child ++;
+    }
+
+    if (requests[child].address <= request.address)
+      break;
+
+    requests[index] = requests[child];
+    index           = child;
+  }
+
+  requests[index] = request;
+}
+
+static void SortDebugRequests(struct DebugRequest* requests, size_t count)
+{
+  size_t length;
+  struct DebugRequest request;
+
+  // Heap sort is used since qsort() could call malloc()
+
+  for (length = count / 2; length > 0; length --)
+    SiftDebugRequest(requests, length - 1, count);
+
+  for (length = count; length > 1; length --)
+  {
+    request              = requests[0];
+    requests[0]          = requests[length - 1];
+    requests[length - 1] = request;
+    SiftDebugRequest(requests, 0, length - 1);
+  }
+}
+
+static int ResolveDebugRequests(struct DebugRequest* requests, size_t count, struct DebugSegment* segments, size_t length, struct DebugSourceInformation* results, int lock)
+{
+  int result;
+  uintptr_t base;
+  struct DebugUnit* unit;
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct SourceTable* source;
+  struct DebugSegment* segment;
+  struct DebugSegment* boundary;
+  struct DebugRequest* request;
+  struct DebugRequest* first;
+  struct DebugRequest* limit;
+
+  // Both requests and segments are sorted by address, so both could be walked at once
+
+  result   = 0;
+  request  = requests;
+  limit    = requests + count;
+  segment  = segments;
+  boundary = segments + length;
+
+  while ((request < limit) &&
+         (segment < boundary))
+  {
+    if (request->address >= segment->end)
+    {
+      segment ++;
+      continue;
+    }
+
+    if (request->address < segment->start)
+    {
+      // Address does not belong to any module
+      request ++;
+      continue;
+    }
+
+    // All addresses of the segment belong to the same module, resolve it once
+
+    first = request;
+
+    while ((request < limit) &&
+           (request->address < segment->end))
+      request ++;
+
+    base = segment->base;
+    unit = (lock == DEBUG_GET_SIGNAL_SAFE) ?
+      (struct DebugUnit*)atomic_load_explicit(&segment->module->unit, memory_order_acquire) :
+      GetDebugUnit(segment->module, NULL, lock);
+
+    if ((unit  != NULL) &&
+        (index  = GetDebugIndex(unit, lock)))
+    {
+      TouchDebugStamp(&unit->stamp);
+
+      range  = NULL;
+      source = NULL;
+
+      for ( ; first < request; first ++)
+      {
+        if ((first > requests) &&
+            (first->address == (first - 1)->address))
+        {
+          // Duplicate address, copy the previous result
+          results[first->index] = results[(first - 1)->index];
+          result += (results[first->index].address != 0);
+          continue;
+        }
+
+        if ((first->address >= base) &&
+            (CheckMissCache(unit, first->address - base) == 0))
+        {
+          // Lookup is cheap for addresses in the same compilation unit
+          result += ResolveDebugAddress(unit, index, base, first->address, &range, &source, results + first->index, lock);
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+int GetDebugInformationBatch(const uintptr_t* addresses, size_t count, struct DebugSourceInformation* results, int lock)
+{
+  int result;
+  size_t number;
+  size_t offset;
+  unsigned int period;
+  struct DebugArena* current;
+  struct DebugRequest* requests;
+  struct DebugRequest* request;
+
+  memset(results, 0, count * sizeof(struct DebugSourceInformation));
+
+  if (lock == DEBUG_GET_SIGNAL_SAFE)
+  {
+    // Use only the module map and the static scratch
+
+    result  = 0;
+    period  = EnterDebugCache();
+    current = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_acquire);
+
+    if ((current != NULL) &&
+        (atomic_flag_test_and_set_explicit(&scratch.busy, memory_order_acquire) == 0))
+    {
+      for (offset = 0; offset < count; offset += number)
+      {
+        number = count - offset;
+        number = (number < DEBUG_SCRATCH_SIZE) ? number : DEBUG_SCRATCH_SIZE;
+
+        for (request = scratch.requests; request < scratch.requests + number; request ++)
+        {
+          request->index   = offset + (request - scratch.requests);
+          request->address = addresses[request->index];
+        }
+
+        SortDebugRequests(scratch.requests, number);
+        result += ResolveDebugRequests(scratch.requests, number, current->segments, current->length, results, lock);
+      }
+
+      atomic_flag_clear_explicit(&scratch.busy, memory_order_release);
+      LeaveDebugCache(period);
+      return result;
+    }
+
+    LeaveDebugCache(period);
+
+    for (offset = 0; offset < count; offset ++)
+    {
+      // Scratch is used by another handler, resolve addresses one by one
+      result += GetDebugInformation(NULL, NULL, addresses[offset], results + offset, lock);
+    }
+
+    return result;
+  }
+
+  // Arena is not unmapped while it's in use
+
+  period = EnterDebugCache();
+
+  if ((count    == 0) ||
+      (current  = RefreshDebugArena(lock)) == NULL ||
+      (requests = (struct DebugRequest*)malloc(count * sizeof(struct DebugRequest))) == NULL)
+  {
+    // Nothing to do
+    LeaveDebugCache(period);
+    return 0;
+  }
+
+  for (request = requests; request < requests + count; request ++)
+  {
+    request->address = addresses[request - requests];
+    request->index   = request - requests;
+  }
+
+  // Units are resolved once per segment of the module map
+
+  SortDebugRequests(requests, count);
+  result = ResolveDebugRequests(requests, count, current->segments, current->length, results, lock);
+  LeaveDebugCache(period);
+
+  free(requests);
+  CheckDebugCacheBudget(lock);
+  return result;
+}
+
+void ReleaseDebugInformation(struct DebugSourceInformation* information)
+{
+  // Path points to the interned table of unit, nothing to release
+}
+
+const char* GetDebugFilePath(uint32_t file)
+{
+  const char* path;
+
+  pthread_mutex_lock(&registrar);
+  path = ((file != 0) && (file < registry.count)) ? registry.paths[file] : NULL;
+  pthread_mutex_unlock(&registrar);
+
+  return path;
+}
+
+size_t GetDebugFileList(const char** list, size_t count)
+{
+  size_t number;
+
+  // list[n] is a path of file n, list[0] is always NULL
+
+  pthread_mutex_lock(&registrar);
+
+  for (number = 0; (number < count) && (number < registry.count); number ++)
+    list[number] = (number != 0) ? registry.paths[number] : NULL;
+
+  number = registry.count;
+  pthread_mutex_unlock(&registrar);
+
+  return number;
+}
+
+// Backtrace
+
+static void WriteDebugText(struct DebugWriter* writer, const char* text)
+{
+  // Text is truncated, the buffer is always terminated
+
+  for ( ; (*text != '\0') && (writer->length + 1 < writer->size); text ++)
+    writer->buffer[writer->length ++] = *text;
+
+  if (writer->size != 0)
+    writer->buffer[writer->length] = '\0';
+}
+
+static void WriteDebugNumber(struct DebugWriter* writer, uint64_t value, int base, int width)
+{
+  char text[24];
+  char* pointer;
+
+  // snprintf() is not async-signal-safe
+
+  pointer  = text + sizeof(text) - 1;
+  *pointer = '\0';
+
+  do
+  {
+    *(-- pointer) = "0123456789abcdef"[value % base];
+    value        /= base;
+    width --;
+  }
+  while ((value != 0) || (width > 0));
+
+  WriteDebugText(writer, pointer);
+}
+
+static size_t ResolveDebugFrame(uintptr_t address, int adjust, struct DebugFrameInformation* frame, struct DebugSourceInformation* chain, int lock)
+{
+  size_t count;
+  unsigned int period;
+  unsigned int version;
+  struct DebugArena* current;
+  struct DebugSegment* segment;
+  struct DebugFrameRecord record;
+  struct DebugSymbolInformation symbol;
+
+  // Return address points past the call, so the call itself is looked up,
+  // the address interrupted by a signal is looked up as is
+
+  memset(frame, 0, sizeof(struct DebugFrameInformation));
+
+  frame->address = address;
+  address       -= adjust;
+  period         = EnterDebugCache();
+  version        = GetFrameVersion(lock);
+
+  if ((FindFrameRecord(address, version, &record) != 0) &&
+      (record.flags & DEBUG_FRAME_SYMBOL) &&
+      (record.depth == 1))
+  {
+    // Hot frame without inlined subroutines
+    frame->module = record.module;
+    frame->base   = record.base;
+    frame->symbol = record.symbol;
+    frame->offset = (record.symbol != NULL) ? frame->address - record.start : 0;
+    frame->source = record.source;
+    chain[0]      = record.source;
+    LeaveDebugCache(period);
+    return 1;
+  }
+
+  LeaveDebugCache(period);
+
+  count = GetDebugInformationChain(address, chain, DEBUG_TRACE_INLINE, lock);
+
+  if (count != 0)
+  {
+    // The innermost source location
+    frame->source = chain[0];
+  }
+
+  // Names of modules are interned, only the segment has to be read inside the cache
+
+  period  = EnterDebugCache();
+  current = (struct DebugArena*)atomic_load_explicit(&arena, memory_order_acquire);
+
+  if (segment = FindDebugSegment(current, address))
+  {
+    frame->module = segment->module->name;
+    frame->base   = segment->base;
+  }
+
+  LeaveDebugCache(period);
+
+  memset(&record, 0, sizeof(struct DebugFrameRecord));
+
+  if (GetDebugSymbol(address, &symbol, lock) != 0)
+  {
+    frame->symbol = symbol.name;
+    frame->offset = frame->address - symbol.address;
+    record.symbol = symbol.name;
+    record.start  = symbol.address;
+  }
+
+  if (count != 0)
+  {
+    // Unresolved frames are not cached, debug information could be brought later
+    record.version = version;
+    record.flags   = DEBUG_FRAME_SOURCE | DEBUG_FRAME_SYMBOL;
+    record.address = address;
+    record.module  = frame->module;
+    record.base    = frame->base;
+    record.depth   = (count < DEBUG_TRACE_INLINE) ? count : 0;
+    record.source  = chain[0];
+    StoreFrameRecord(&record);
+  }
+
+  return count;
+}
+
+static __attribute__((noinline)) size_t UnwindDebugStack(void* context, size_t depth, size_t skip, int lock, int (*handler)(struct DebugFrameInformation*, struct DebugSourceInformation*, size_t, void*), void* data)
+{
+  int result;
+  int adjust;
+  size_t count;
+  size_t number;
+  unw_word_t value;
+  unw_cursor_t cursor;
+  struct DebugFrameInformation frame;
+  struct DebugSourceInformation chain[DEBUG_TRACE_INLINE];
+
+  if (context != NULL)
+  {
+    // Likely called by signal handler, the first frame is the interrupted one
+    unw_init_local2(&cursor, (unw_context_t*)context, UNW_INIT_SIGNAL_FRAME);
+    result = 1;
+    adjust = 0;
+  }
+  else
+  {
+    // Frames of the unwinder and of the public call are skipped, so neither of them is inlined
+    context = alloca(sizeof(unw_context_t));
+    unw_getcontext((unw_context_t*)context);
+    unw_init_local(&cursor, (unw_context_t*)context);
+    result = (unw_step(&cursor) > 0) && (unw_step(&cursor) > 0);
+    adjust = 1;
+  }
+
+  for (number = 0; (result > 0) && (number < depth + skip) && (unw_get_reg(&cursor, UNW_REG_IP, &value) == 0) && (value != 0); number ++)
+  {
+    if (number >= skip)
+    {
+      count = ResolveDebugFrame(value, adjust, &frame, chain, lock);
+
+      if (handler(&frame, chain, count, data) == 0)
+      {
+        // Output is full
+        number ++;
+        break;
+      }
+    }
+
+    // Frame interrupted by a signal is not a return address
+    adjust = (unw_is_signal_frame(&cursor) <= 0);
+    result = unw_step(&cursor);
+  }
+
+  return (number > skip) ? number - skip : 0;
+}
+
+static int HandleFrameInformation(struct DebugFrameInformation* frame, struct DebugSourceInformation* chain, size_t count, void* data)
+{
+  struct DebugFrameInformation** pointer;
+
+  pointer = (struct DebugFrameInformation**)data;
+  *((*pointer) ++) = *frame;
+
+  return 1;
+}
+
+static int HandleFrameText(struct DebugFrameInformation* frame, struct DebugSourceInformation* chain, size_t count, void* data)
+{
+  size_t number;
+  const char* name;
+  struct DebugWriter* writer;
+
+  // #0 0x00007f0123456789 in function at path:line:column
+  // #1 0x00007f0123456789 in function+0x1f (module)
+
+  writer = (struct DebugWriter*)data;
+
+  for (number = 0; number < count; number ++)
+  {
+    name = chain[number].function;
+
+    if ((number + 1 == count) &&
+        (frame->symbol != NULL) &&
+        ((name == NULL) ||
+         (strncmp(name, "_Z", 2) == 0) && (strncmp(frame->symbol, "_Z", 2) != 0)))
+    {
+      // Names of tables are demangled when built, the symbol is used when only it is readable
+      name = frame->symbol;
+    }
+
+    WriteDebugText(writer, "#");
+    WriteDebugNumber(writer, writer->number ++, 10, 0);
+    WriteDebugText(writer, " 0x");
+    WriteDebugNumber(writer, frame->address, 16, sizeof(uintptr_t) * 2);
+    WriteDebugText(writer, " in ");
+    WriteDebugText(writer, (name != NULL) ? name : "??");
+    WriteDebugText(writer, " at ");
+    WriteDebugText(writer, (chain[number].path != NULL) ? chain[number].path : "??");
+    WriteDebugText(writer, ":");
+    WriteDebugNumber(writer, chain[number].line, 10, 0);
+    WriteDebugText(writer, ":");
+    WriteDebugNumber(writer, chain[number].column, 10, 0);
+    WriteDebugText(writer, (number + 1 < count) ? " (inlined)\n" : "\n");
+  }
+
+  if (count == 0)
+  {
+    WriteDebugText(writer, "#");
+    WriteDebugNumber(writer, writer->number ++, 10, 0);
+    WriteDebugText(writer, " 0x");
+    WriteDebugNumber(writer, frame->address, 16, sizeof(uintptr_t) * 2);
+    WriteDebugText(writer, " in ");
+    WriteDebugText(writer, (frame->symbol != NULL) ? frame->symbol : "??");
+
+    if (frame->symbol != NULL)
+    {
+      WriteDebugText(writer, "+0x");
+      WriteDebugNumber(writer, frame->offset, 16, 0);
+    }
+
+    if (frame->module != NULL)
+    {
+      WriteDebugText(writer, " (");
+      WriteDebugText(writer, frame->module);
+      WriteDebugText(writer, "+0x");
+      WriteDebugNumber(writer, frame->address - frame->base, 16, 0);
+      WriteDebugText(writer, ")");
+    }
+
+    WriteDebugText(writer, "\n");
+  }
+
+  return writer->length + 1 < writer->size;
+}
+
+__attribute__((noinline)) size_t GetDebugBacktrace(void* context, struct DebugFrameInformation* frames, size_t depth, size_t skip, int lock)
+{
+  return UnwindDebugStack(context, depth, skip, lock, HandleFrameInformation, &frames);
+}
+
+__attribute__((noinline)) size_t FormatDebugBacktrace(void* context, char* buffer, size_t size, size_t depth, size_t skip, int lock)
+{
+  struct DebugWriter writer;
+
+  writer.buffer = buffer;
+  writer.size   = size;
+  writer.length = 0;
+  writer.number = 0;
+
+  WriteDebugText(&writer, "");
+  UnwindDebugStack(context, depth, skip, lock, HandleFrameText, &writer);
+
+  return writer.length;
+}
+
+// Unit preloading
+
+static int IsLoaderCancelled(struct DebugLoader* loader)
+{
+  return atomic_load_explicit(&generation, memory_order_relaxed) != loader->generation;
+}
+
+static void RunDebugWorkers(void* (*routine)(void*), void* argument, size_t count, size_t limit, const char* name)
+{
+  pthread_t* threads;
+  size_t number;
+  long online;
+
+  // Work is taken by a bounded pool of workers, the current thread is one of them
+
+  online  = sysconf(_SC_NPROCESSORS_ONLN);
+  limit   = ((online > 0) && ((size_t)online < limit)) ? (size_t)online : limit;
+  count   = (count < limit) ? count : limit;
+  threads = (pthread_t*)alloca((count + 1) * sizeof(pthread_t));
+
+  for (number = 1; (number < count) && (pthread_create(threads + number, NULL, routine, argument) == 0); number ++)
+    pthread_setname_np(threads[number], name);
+
+  routine(argument);
+
+  while (number > 1)
+  {
+    number --;
+    pthread_join(threads[number], NULL);
+  }
+}
+
+static int OpenDebugReplica(struct DebugUnit* unit, struct DebugReplica* replica)
+{
+  char path[64];
+  Dwarf_Error error;
+
+  // Called with lock of the unit held, the file is reopened to not share its offset
+
+  sprintf(path, "/proc/self/fd/%d", unit->handle);
+
+  replica->instance    = NULL;
+  memset(&replica->package, 0, sizeof(struct SplitPackage));
+  replica->handle      = open(path, O_RDONLY);
+  replica->module      = (replica->handle >= 0) ? elf_begin(replica->handle, ELF_C_READ, NULL) : NULL;
+  replica->list.data   = NULL;
+  replica->list.size   = 0;
+  replica->list.length = 0;
+
+  if (replica->module != NULL)
+  {
+    // Result does not matter
+#ifndef DW_LIBDWARF_VERSION
+    dwarf_elf_init(replica->module, DW_DLC_READ, NULL, NULL, &replica->instance, &error);
+#else
+    dwarf_init_b(replica->handle, DW_GROUPNUMBER_ANY, NULL, NULL, &replica->instance, &error);
+#endif
+  }
+
+  if (replica->instance == NULL)
+  {
+    elf_end(replica->module);
+    close(replica->handle);
+    return 0;
+  }
+
+  // Loaded sections are accounted by the budget the same way as the instance of the unit
+  replica->weight = unit->weight;
+  atomic_fetch_add_explicit(&usage, replica->weight, memory_order_relaxed);
+  return 1;
+}
+
+static void CloseDebugReplica(struct DebugReplica* replica)
+{
+  CloseSplitPackage(&replica->package);
+
+#ifndef DW_LIBDWARF_VERSION
+  dwarf_finish(replica->instance, NULL);
+#else
+  dwarf_finish(replica->instance);
+#endif
+
+  elf_end(replica->module);
+  close(replica->handle);
+  free(replica->list.data);
+
+  atomic_fetch_sub_explicit(&usage, replica->weight, memory_order_relaxed);
+}
+
+static int MergeRangeLists(struct DebugReplica* replicas, size_t count)
+{
+  size_t number;
+  size_t length;
+  struct RangeList* list;
+  struct RangeList* other;
+  struct DebugRange* data;
+
+  // Ranges of all workers are moved to the first one, the order does not matter since they are sorted later
+
+  list   = &replicas->list;
+  length = list->length;
+
+  for (number = 1; number < count; number ++)
+    length += replicas[number].list.length;
+
+  if ((length > list->size) &&
+      (data = (struct DebugRange*)realloc(list->data, length * sizeof(struct DebugRange))))
+  {
+    list->data = data;
+    list->size = length;
+  }
+
+  if (length > list->size)
+  {
+    // Out of memory
+    return 0;
+  }
+
+  for (number = 1; number < count; number ++)
+  {
+    other = &replicas[number].list;
+    memcpy(list->data + list->length, other->data, other->length * sizeof(struct DebugRange));
+    list->length += other->length;
+  }
+
+  return 1;
+}
+
+static void* DoCollect(void* argument)
+{
+  struct DebugBuilder* builder;
+  struct DebugReplica* replica;
+  size_t number;
+
+  builder = (struct DebugBuilder*)argument;
+  replica = builder->replicas + atomic_fetch_add_explicit(&builder->worker, 1, memory_order_relaxed);
+
+  while ((IsLoaderCancelled(builder->loader) == 0) &&
+         ((number = atomic_fetch_add_explicit(&builder->next, 1, memory_order_relaxed)) < builder->count))
+    CollectUnitRanges(builder->unit, replica->instance, builder->offsets[number], &replica->list);
+
+  return NULL;
+}
+
+static void* DoBuild(void* argument)
+{
+  uint64_t start;
+  size_t number;
+  struct DebugUnit* unit;
+  struct SourceSlot* slot;
+  struct SourceTable* source;
+  struct DebugBuilder* builder;
+  struct DebugReplica* replica;
+
+  // Index is kept alive by the epoch entered by the thread started the build
+
+  builder = (struct DebugBuilder*)argument;
+  replica = builder->replicas + atomic_fetch_add_explicit(&builder->worker, 1, memory_order_relaxed);
+  unit    = builder->unit;
+
+  while ((IsLoaderCancelled(builder->loader) == 0) &&
+         ((number = atomic_fetch_add_explicit(&builder->next, 1, memory_order_relaxed)) < builder->index->count))
+  {
+    slot = builder->index->slots + number;
+
+    if ((atomic_load_explicit(&slot->table, memory_order_relaxed) != 0) ||
+        (atomic_load_explicit(&unit->index, memory_order_relaxed) != (uintptr_t)builder->index))
+    {
+      // Table has been built by a lookup or the index has been evicted
+      continue;
+    }
+
+    start  = GetDebugTime();
+    source = BuildSourceTable(unit, replica->instance, &replica->package, slot->offset);
+    CountDebugTime(unit, DEBUG_TIER_SOURCE, start);
+    CountDebugEvent(unit, DEBUG_COUNTER_MISSES, 1);
+
+    if ((source != NULL) &&
+        (LockDebugUnit(unit, DEBUG_GET_LOCK_WAIT) != 0))
+    {
+      if ((atomic_load_explicit(&slot->table, memory_order_relaxed) == 0) &&
+          (atomic_load_explicit(&unit->index, memory_order_relaxed) == (uintptr_t)builder->index))
+      {
+        // Publish complete table, the same way as a lookup does
+        atomic_fetch_add_explicit(&usage, GetSourceTableWeight(source, 0), memory_order_relaxed);
+        atomic_store_explicit(&slot->table, (uintptr_t)source, memory_order_release);
+        ClearMissCache(unit);
+        source = NULL;
+      }
+
+      pthread_mutex_unlock(&unit->lock);
+    }
+
+    ReleaseSourceTable(source, 0);
+  }
+
+  return NULL;
+}
+
+static void BuildDebugUnit(struct DebugUnit* unit, struct DebugLoader* loader)
+{
+  long pages;
+  uint64_t start;
+  size_t limit;
+  size_t count;
+  size_t number;
+  size_t current;
+  struct DebugIndex* index;
+  struct DebugBuilder builder;
+  struct DebugReplica replicas[DEBUG_BUILDER_LIMIT];
+
+  // Huge units are built by several workers at once, called within the epoch,
+  // number of workers is bounded by the budget since each one loads DWARF again
+
+  limit   = atomic_load_explicit(&budget, memory_order_relaxed);
+  current = atomic_load_explicit(&usage, memory_order_relaxed);
+  count   = DEBUG_BUILDER_LIMIT;
+
+  if ((unit == NULL) ||
+      (unit->weight < DEBUG_BUILDER_WEIGHT) ||
+      (atomic_load_explicit(&unit->index, memory_order_acquire) != 0))
+  {
+    // Sequential build is good enough
+    return;
+  }
+
+  if ((limit == 0) &&
+      ((pages = sysconf(_SC_AVPHYS_PAGES)) > 0))
+  {
+    // Without a budget copies of DWARF take up to a half of available memory,
+    // other loaders could build huge units at the same time
+    limit = current + (size_t)pages * (size_t)sysconf(_SC_PAGESIZE) / 2;
+  }
+
+  if ((limit == 0) ||
+      (current >= limit) ||
+      ((count = (limit - current) / unit->weight) < 2))
+  {
+    // Not enough memory for copies of DWARF or it's unknown
+    return;
+  }
+
+  count = (count < DEBUG_BUILDER_LIMIT) ? count : DEBUG_BUILDER_LIMIT;
+
+  memset(&builder, 0, sizeof(struct DebugBuilder));
+  atomic_init(&builder.worker, 0);
+  atomic_init(&builder.next, 0);
+
+  builder.unit     = unit;
+  builder.loader   = loader;
+  builder.replicas = replicas;
+
+  pthread_mutex_lock(&unit->lock);
+  AdoptDebugUnit(unit);
+
+  if ((unit->instance != NULL) &&
+      (atomic_load_explicit(&unit->index, memory_order_relaxed)   == 0) &&
+      (atomic_load_explicit(&unit->evicted, memory_order_relaxed) == 0))
+  {
+    while ((builder.length < count) &&
+           (OpenDebugReplica(unit, replicas + builder.length) != 0))
+      builder.length ++;
+  }
+
+  if (builder.length > 1)
+  {
+    // Index is built under the lock like a sequential one, only the walk over compilation units is shared
+
+    start         = GetDebugTime();
+    builder.count = CollectUnitOffsets(unit, &builder.offsets);
+
+    CollectArangeList(unit, &replicas->list);
+    RunDebugWorkers(DoCollect, &builder, builder.count, builder.length, "Builder");
+
+    if ((IsLoaderCancelled(loader) == 0) &&
+        (MergeRangeLists(replicas, builder.length) != 0))
+    {
+      index               = MakeDebugIndex(&replicas->list);
+      replicas->list.data = NULL;
+
+      CountDebugTime(unit, DEBUG_TIER_INDEX, start);
+      CountDebugEvent(unit, DEBUG_COUNTER_MISSES, 1);
+
+      if (index != NULL)
+      {
+        // Publish complete index
+        atomic_fetch_add_explicit(&usage, GetDebugIndexWeight(index), memory_order_relaxed);
+        atomic_store_explicit(&unit->index, (uintptr_t)index, memory_order_release);
+        ClearMissCache(unit);
+        builder.index = index;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&unit->lock);
+
+  if (builder.index != NULL)
+  {
+    // Tables are built without the lock, lookups are still served meanwhile
+    atomic_store_explicit(&builder.worker, 0, memory_order_relaxed);
+    atomic_store_explicit(&builder.next, 0, memory_order_relaxed);
+    RunDebugWorkers(DoBuild, &builder, builder.index->count, builder.length, "Builder");
+  }
+
+  for (number = 0; number < builder.length; number ++)
+    CloseDebugReplica(replicas + number);
+
+  free(builder.offsets);
+}
+
+static int IsDebugIndexComplete(struct DebugUnit* unit, struct DebugIndex* index)
 {
-  struct SourceLine* line1;
-  struct SourceLine* line2;
+  size_t number;
+
+  // Called with lock of the unit held, so tables could not be evicted meanwhile
+
+  if (atomic_load_explicit(&unit->index, memory_order_relaxed) != (uintptr_t)index)
+    return 0;
+
+  for (number = 0; number < index->count; number ++)
+    if (atomic_load_explicit(&index->slots[number].table, memory_order_relaxed) == 0)
+      return 0;
+
+  return 1;
+}
+
+static void PrepareDebugUnit(struct DebugUnit* unit, struct DebugLoader* loader)
+{
+  size_t number;
+  unsigned int current;
+  struct DebugIndex* index;
+
+  // Build all tables of the unit eagerly, the first lookup should not pay for it
+
+  current = EnterDebugCache();
+
+  BuildDebugUnit(unit, loader);
+
+  if ((unit != NULL) &&
+      (unit->instance != NULL) &&
+      (index = GetDebugIndex(unit, DEBUG_GET_LOCK_WAIT)) &&
+      (index->mapping == NULL))
+  {
+    for (number = 0; (number < index->count) && (IsLoaderCancelled(loader) == 0); number ++)
+      GetSourceTable(unit, index, index->slots + number, DEBUG_GET_LOCK_WAIT);
+
+    if ((number     == index->count) &&
+        (unit->size != 0)            &&
+        (*directory != '\0'))
+    {
+      // Make the index persistent, unless some tables have been evicted by the budget
+      pthread_mutex_lock(&unit->lock);
+      pthread_mutex_lock(&unit->interner);
+      if (IsDebugIndexComplete(unit, index) != 0)
+        StoreDebugIndex(unit, index);
+      pthread_mutex_unlock(&unit->interner);
+      pthread_mutex_unlock(&unit->lock);
+    }
+  }
+
+  LeaveDebugCache(current);
+  CheckDebugCacheBudget(DEBUG_GET_LOCK_WAIT);
+}
+
+static int HandleLoadProgress(debuginfod_client* client, long value1, long value2)
+{
+  return IsLoaderCancelled((struct DebugLoader*)debuginfod_get_user_data(client));
+}
+
+static void* DoLoad(void* argument)
+{
+  struct DebugLoader* loader;
+  debuginfod_client* client;
+  size_t number;
+
+  // debuginfod client is not thread-safe, each worker has its own one
+
+  loader = (struct DebugLoader*)argument;
+  client = debuginfod_begin();
+
+  if (client != NULL)
+  {
+    debuginfod_set_user_data(client, loader);
+    debuginfod_set_progressfn(client, HandleLoadProgress);
+  }
+
+  while ((IsLoaderCancelled(loader) == 0) &&
+         ((number = atomic_fetch_add_explicit(&loader->next, 1, memory_order_relaxed)) < loader->count))
+  {
+    PrepareDebugUnit(GetDebugUnit(loader->modules + number, client, DEBUG_GET_LOCK_WAIT), loader);
+    atomic_fetch_add_explicit(progress + 0, 1, memory_order_relaxed);
+  }
+
+  if (client != NULL)
+  {
+    // Result does not matter
+    debuginfod_end(client);
+  }
+
+  return NULL;
+}
+
+static void TryUpdateDebugCache(int version)
+{
+  unsigned int period;
+  struct DebugLoader loader;
+  struct DebugArena* current;
+
+  // Modules of the current module map are loaded, the arena is kept while workers use it,
+  // the generation is taken by the caller, so a cancellation issued during the refresh is not lost
+
+  period = EnterDebugCache();
+
+  if ((current = RefreshDebugArena(DEBUG_GET_LOCK_WAIT)) == NULL)
+  {
+    // Out of memory
+    LeaveDebugCache(period);
+    return;
+  }
+
+  loader.generation = version;
+  loader.modules    = current->modules;
+  loader.count      = current->count;
+
+  atomic_init(&loader.next, 0);
+
+  atomic_store_explicit(progress + 0, 0, memory_order_relaxed);
+  atomic_store_explicit(progress + 1, loader.count, memory_order_relaxed);
+
+  RunDebugWorkers(DoLoad, &loader, loader.count, DEBUG_LOADER_LIMIT, "Loader");
+  LeaveDebugCache(period);
+}
+
+static void ShareDebugUnit(struct DebugUnit* unit)
+{
+  int result;
+  int handle;
+  FILE* file;
+  char path[PATH_MAX];
+  struct DebugIndex* index;
+  struct DebugIndex* shared;
+
+  // Called with trimmer, lock and interner of the unit held
+
+  index  = (struct DebugIndex*)atomic_load_explicit(&unit->index, memory_order_relaxed);
+  shared = NULL;
+
+  if ((index == NULL) ||
+      (index->mapping != NULL) ||
+      (IsDebugIndexComplete(unit, index) == 0))
+  {
+    // Index is mapped already or it's incomplete
+    return;
+  }
+
+  if ((FormatDebugCachePath(unit, path, ".index") != 0) &&
+      ((handle = open(path, O_RDONLY)) >= 0))
+  {
+    // Index stored by preload, its pages are shared even with unrelated processes
+    shared = MapDebugIndex(unit, handle);
+  }
+
+  if ((shared == NULL) &&
+      ((handle = memfd_create("DebugDecoder", MFD_CLOEXEC)) >= 0))
+  {
+    // Anonymous file is shared with processes forked after
+    result = 0;
+
+    if (file = fdopen(dup(handle), "w"))
+    {
+      result = WriteDebugIndex(unit, index, file);
+      result = (fclose(file) == 0) && (result != 0);
+    }
+
+    if (result != 0)
+      shared = MapDebugIndex(unit, handle);
+    else
+      close(handle);
+  }
+
+  if ((shared != NULL) &&
+      (ReserveDebugRetiree() == 0))
+  {
+    // Out of memory, private index could not be retired
+    ReleaseDebugIndex(shared);
+    shared = NULL;
+  }
+
+  if (shared != NULL)
+  {
+    // Private index is released when readers leave, DWARF is not required anymore
+    atomic_fetch_add_explicit(&usage, GetDebugIndexWeight(shared), memory_order_relaxed);
+    atomic_store_explicit(&unit->index, (uintptr_t)shared, memory_order_release);
+    ClearMissCache(unit);
+    RetireDebugObject(DEBUG_RETIRE_INDEX, index, GetDebugIndexWeight(index));
+    ReleaseDebugInstance(unit);
+  }
+}
+
+static void ShareDebugCache()
+{
+  struct DebugUnit* unit;
+
+  // Complete indexes are moved to read-only shared mappings, so processes forked after that
+  // use the same pages and never copy them on write, symbol tables are built once as well
+
+  pthread_mutex_lock(&trimmer);
+
+  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire); unit != NULL; unit = (struct DebugUnit*)unit->next)
+  {
+    GetSymbolTable(unit, DEBUG_GET_LOCK_WAIT);
+
+    pthread_mutex_lock(&unit->lock);
+    pthread_mutex_lock(&unit->interner);
+    ShareDebugUnit(unit);
+    pthread_mutex_unlock(&unit->interner);
+    pthread_mutex_unlock(&unit->lock);
+  }
+
+  ReclaimDebugCache();
+  pthread_mutex_unlock(&trimmer);
+}
+
+static void* DoWork(void* argument)
+{
+  pthread_t thread;
+
+  thread = pthread_self();
+
+  pthread_setname_np(thread, "Loader");
+
+  TryUpdateDebugCache((int)(intptr_t)argument);
+  atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
+
+  pthread_detach(thread);
+  return NULL;
+}
+
+void UpdateDebugCache(int option)
+{
+  int version;
+  pthread_t thread;
+
+  // CancelUpdateDebugCache() called after return cancels the update even before the worker has started
+
+  version = atomic_load_explicit(&generation, memory_order_relaxed);
+
+  if (option == DEBUG_UPDATE_SYNCHRONOUS)
+  {
+    TryUpdateDebugCache(version);
+    return;
+  }
+
+  if (option == DEBUG_UPDATE_SHARED)
+  {
+    TryUpdateDebugCache(version);
+    ShareDebugCache();
+    return;
+  }
+
+  if ((option == DEBUG_UPDATE_ASYNCHRONOUS) &&
+      (atomic_exchange_explicit(&state, DEBUG_UPDATE_ASYNCHRONOUS, memory_order_relaxed) == DEBUG_UPDATE_SYNCHRONOUS) &&
+      (pthread_create(&thread, NULL, DoWork, (void*)(intptr_t)version) != 0))
+  {
+    atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
+    return;
+  }
+}
+
+void CancelUpdateDebugCache()
+{
+  // Running workers stop after the current module, downloads are aborted
+  atomic_fetch_add_explicit(&generation, 1, memory_order_relaxed);
+}
+
+int GetDebugCacheProgress(size_t* count, size_t* total)
+{
+  if (count != NULL)
+    *count = atomic_load_explicit(progress + 0, memory_order_relaxed);
+
+  if (total != NULL)
+    *total = atomic_load_explicit(progress + 1, memory_order_relaxed);
+
+  return atomic_load_explicit(&state, memory_order_relaxed);
+}
+
+void SetDebugCacheDirectory(const char* path)
+{
+  if (path == NULL)
+  {
+    // Disable persistent index
+    *directory = '\0';
+    return;
+  }
+
+  snprintf(directory, PATH_MAX, "%s", path);
+}
+
+// Offline snapshots
+
+static size_t AddSnapshotModule(struct SegmentList* list, const char* path, const uint8_t* identifier, size_t size, Elf* image)
+{
+  size_t number;
+  size_t length;
+  uint8_t* data;
+  struct stat status;
+  struct DebugModule* module;
+
+  // Modules of a snapshot are keyed like modules of the process, so units are shared with in-process lookups
+
+  for (number = 0; number < list->count; number ++)
+  {
+    module = list->modules + number;
+
+    if ((strcmp(module->name, path) == 0) &&
+        ((size == 0) ||
+         (size == module->size) && (memcmp(identifier, module->identifier, size) == 0)))
+      return number;
+  }
+
+  if ((list->count == list->capacity) &&
+      (module = (struct DebugModule*)realloc(list->modules, (list->capacity + 64) * sizeof(struct DebugModule))))
+  {
+    list->modules   = module;
+    list->capacity += 64;
+  }
+
+  if (list->count == list->capacity)
+  {
+    // Out of memory
+    return SIZE_MAX;
+  }
+
+  module = list->modules + list->count;
+  memset(module, 0, sizeof(struct DebugModule));
+  atomic_init(&module->unit, 0);
+
+  if (stat(path, &status) == 0)
+  {
+    // File is available on this machine
+    module->device = status.st_dev;
+    module->inode  = status.st_ino;
+  }
+
+  if ((size == 0) &&
+      (image != NULL) &&
+      (data = GetBuildID(image, &length)))
+  {
+    // Maps do not carry Build ID, take it from the file
+    identifier = data;
+    size       = (length < sizeof(module->identifier)) ? length : sizeof(module->identifier);
+  }
+
+  if (module->size = size)
+    memcpy(module->identifier, identifier, size);
+
+  if ((module->inode == 0) &&
+      (module->size  == 0) ||
+      (module->name = strdup(path)) == NULL)
+  {
+    // Neither file nor Build ID, there is nothing to key a unit by
+    return SIZE_MAX;
+  }
+
+  return list->count ++;
+}
+
+static int AddSnapshotSegment(struct SegmentList* list, uintptr_t start, uintptr_t end, uintptr_t base, size_t number)
+{
+  struct DebugSegment* segment;
+
+  if ((list->length == list->size) &&
+      (segment = (struct DebugSegment*)realloc(list->data, (list->size + 64) * sizeof(struct DebugSegment))))
+  {
+    list->data  = segment;
+    list->size += 64;
+  }
+
+  if (list->length == list->size)
+  {
+    // Out of memory
+    return 0;
+  }
+
+  segment         = list->data + list->length;
+  segment->start  = start;
+  segment->end    = end;
+  segment->base   = base;
+  segment->module = (struct DebugModule*)number;
+  list->length ++;
+
+  return 1;
+}
+
+static int AddSnapshotMapping(struct SegmentList* list, const char* path, uintptr_t start, uintptr_t end, uintptr_t offset)
+{
+  int result;
+  int handle;
+  size_t count;
+  size_t number;
+  uintptr_t base;
+  GElf_Phdr header;
+  Elf* image;
+
+  // Load bias is found by the program header mapped at the offset, text is assumed to be mapped at its offset otherwise
+
+  handle = open(path, O_RDONLY);
+  image  = (handle >= 0) ? elf_begin(handle, ELF_C_READ, NULL) : NULL;
+  base   = start - offset;
+
+  if ((image != NULL) &&
+      (elf_getphdrnum(image, &count) == 0))
+  {
+    for (number = 0; number < count; number ++)
+    {
+      if ((gelf_getphdr(image, number, &header) != NULL) &&
+          (header.p_type   == PT_LOAD) &&
+          (header.p_offset >= offset) &&
+          (header.p_offset <  offset + ((header.p_align > 1) ? header.p_align : 1)))
+      {
+        base = start - header.p_vaddr + (header.p_offset - offset);
+        break;
+      }
+    }
+  }
+
+  result =
+    ((number = AddSnapshotModule(list, path, NULL, 0, image)) != SIZE_MAX) &&
+    (AddSnapshotSegment(list, start, end, base, number) != 0);
+
+  elf_end(image);
+  close(handle);
+  return result;
+}
+
+static int AddSnapshotBase(struct SegmentList* list, const char* path, const uint8_t* identifier, size_t size, uintptr_t base)
+{
+  int result;
+  int handle;
+  size_t count;
+  size_t number;
+  size_t length;
+  uint8_t* data;
+  GElf_Phdr header;
+  Elf* image;
+
+  // Segments are taken from the file when it is the same build, otherwise the module spans up to the next one
+
+  handle = open(path, O_RDONLY);
+  image  = (handle >= 0) ? elf_begin(handle, ELF_C_READ, NULL) : NULL;
+  data   = (image != NULL) ? GetBuildID(image, &length) : NULL;
+  count  = 0;
+
+  if ((data != NULL) &&
+      (length == size) &&
+      (memcmp(data, identifier, size) == 0))
+  {
+    // Result does not matter
+    elf_getphdrnum(image, &count);
+  }
+
+  if ((number = AddSnapshotModule(list, path, identifier, size, image)) == SIZE_MAX)
+  {
+    elf_end(image);
+    close(handle);
+    return 0;
+  }
+
+  result = (count == 0) && AddSnapshotSegment(list, base, 0, base, number);
+
+  for (length = 0; length < count; length ++)
+  {
+    if ((gelf_getphdr(image, length, &header) != NULL) &&
+        (header.p_type == PT_LOAD))
+      result |= AddSnapshotSegment(list, base + header.p_vaddr, base + header.p_vaddr + header.p_memsz, base, number);
+  }
+
+  elf_end(image);
+  close(handle);
+  return result;
+}
+
+static size_t GetSnapshotBoundary(struct DebugSymbolizer* symbolizer, size_t number)
+{
+  size_t position;
+
+  // Duplicates are copied from the previous request, so they are never split between chunks
+
+  position = number * symbolizer->chunk;
+
+  if (position >= symbolizer->length)
+    return symbolizer->length;
+
+  while ((position > 0) &&
+         (position < symbolizer->length) &&
+         (symbolizer->requests[position].address == symbolizer->requests[position - 1].address))
+    position ++;
+
+  return position;
+}
+
+static void* DoOpenSnapshot(void* argument)
+{
+  struct DebugSymbolizer* symbolizer;
+  debuginfod_client* client;
+  struct DebugUnit* unit;
+  size_t number;
+
+  // Modules are opened and indexed in parallel, debuginfod is asked at once since nobody waits for an answer in real time
+
+  symbolizer = (struct DebugSymbolizer*)argument;
+  client     = debuginfod_begin();
+
+  while ((number = atomic_fetch_add_explicit(&symbolizer->next, 1, memory_order_relaxed)) < symbolizer->count)
+  {
+    if (unit = GetDebugUnit(symbolizer->modules[number], client, DEBUG_GET_LOCK_WAIT))
+    {
+      // Result does not matter
+      GetDebugIndex(unit, DEBUG_GET_LOCK_WAIT);
+    }
 
-  line1 = (struct SourceLine*)pointer1;
-  line2 = (struct SourceLine*)pointer2;
+    CheckDebugCacheBudget(DEBUG_GET_LOCK_WAIT);
+  }
 
-  return (line1->address > line2->address) - (line1->address < line2->address);
+  if (client != NULL)
+  {
+    // Result does not matter
+    debuginfod_end(client);
+  }
+
+  return NULL;
 }
 
-static int CheckRange(struct DebugUnit* unit, Dwarf_Die entry, uintptr_t address)
+static void* DoResolveSnapshot(void* argument)
 {
-  Dwarf_Half form;
-  Dwarf_Error error;
-  Dwarf_Unsigned low;
-  Dwarf_Unsigned high;
-  enum Dwarf_Form_Class type;
-
-  Dwarf_Off offset;
-  Dwarf_Signed count;
-  Dwarf_Ranges* ranges;
-  Dwarf_Unsigned length;
-  Dwarf_Attribute attribute;
-
-  int number;
   int result;
+  size_t first;
+  size_t last;
+  size_t number;
+  unsigned int current;
+  struct DebugSymbolizer* symbolizer;
 
-  low    = 0;
-  high   = 0;
-  result = 0;
-  offset = 0;
+  symbolizer = (struct DebugSymbolizer*)argument;
 
-  if ((dwarf_lowpc(entry, &low, &error)                   == DW_DLV_OK) &&
-      (dwarf_highpc_b(entry, &high, &form, &type, &error) == DW_DLV_OK))
+  while ((first = GetSnapshotBoundary(symbolizer, number = atomic_fetch_add_explicit(&symbolizer->next, 1, memory_order_relaxed))) < symbolizer->length)
   {
-    high += low * (type == DW_FORM_CLASS_CONSTANT);
-    return (address >= low) && (address < high);
+    last    = GetSnapshotBoundary(symbolizer, number + 1);
+    current = EnterDebugCache();
+    result  = ResolveDebugRequests(symbolizer->requests + first, last - first, symbolizer->segments, symbolizer->number, symbolizer->results, DEBUG_GET_LOCK_WAIT);
+
+    LeaveDebugCache(current);
+    CheckDebugCacheBudget(DEBUG_GET_LOCK_WAIT);
+    atomic_fetch_add_explicit(&symbolizer->result, result, memory_order_relaxed);
   }
 
-  if (dwarf_attr(entry, DW_AT_ranges, &attribute, &error) == DW_DLV_OK)  // <-- Memory leak?
-  {
-#ifndef DW_LIBDWARF_VERSION
-    if ((dwarf_global_formref(attribute, &offset, &error)                                    == DW_DLV_OK) &&
-        (dwarf_get_ranges_a(unit->instance, offset, entry, &ranges, &count, &length, &error) == DW_DLV_OK))
-#else
-    if ((dwarf_global_formref(attribute, &offset, &error)                                          == DW_DLV_OK) &&
-        (dwarf_get_ranges_b(unit->instance, offset, entry, NULL, &ranges, &count, &length, &error) == DW_DLV_OK))
+  return NULL;
+}
 
-#endif
-    {
-      for (number = 0; number < count; ++ number)
-      {
-        if ((ranges[number].dwr_addr1 != 0) &&
-            (address >= ranges[number].dwr_addr1 + low) &&
-            (address <  ranges[number].dwr_addr2 + low))
-        {
-          result = 1;
-          break;
-        }
-      }
+struct DebugSnapshot* CreateDebugSnapshot()
+{
+  return (struct DebugSnapshot*)calloc(1, sizeof(struct DebugSnapshot));
+}
 
-#ifndef DW_LIBDWARF_VERSION
-      dwarf_ranges_dealloc(unit->instance, ranges, count);
-#else
-      dwarf_dealloc_ranges(unit->instance, ranges, count);
-#endif
-    }
+void ReleaseDebugSnapshot(struct DebugSnapshot* snapshot)
+{
+  size_t number;
 
-    dwarf_dealloc(unit->instance, attribute, DW_DLA_ATTR);
-  }
+  // Units stay in the cache, they are shared with other snapshots and the process
 
-  return result;
+  if (snapshot != NULL)
+  {
+    for (number = 0; number < snapshot->list.count; number ++)
+      free((char*)snapshot->list.modules[number].name);
+
+    free(snapshot->list.modules);
+    free(snapshot->list.data);
+    free(snapshot);
+  }
 }
 
-static int IterateOverChildren(struct DebugUnit* unit, Dwarf_Die* entry, uintptr_t address)
+int AddDebugSnapshotLine(struct DebugSnapshot* snapshot, const char* line)
 {
-  int result;
+  int offset;
+  size_t size;
+  size_t length;
+  uintptr_t start;
+  uintptr_t end;
+  uintptr_t position;
+  unsigned long inode;
+  uint8_t identifier[64];
+  char permissions[8];
+  char text[129];
+  char* path;
 
-  Dwarf_Die current;
-  Dwarf_Die previous;
+  path = (char*)alloca(PATH_MAX);
 
-  Dwarf_Half tag;
-  Dwarf_Bool flag;
-  Dwarf_Error error;
-  Dwarf_Attribute attribute;
+  // Line of /proc/<pid>/maps: start-end permissions offset device inode path
 
-  if (dwarf_child(*entry, &current, &error) == DW_DLV_OK)
+  if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %7s %" SCNxPTR " %*x:%*x %lu %n", &start, &end, permissions, &position, &inode, &offset) == 5)
   {
-    do
-    {
-      if ((dwarf_tag(current, &tag, &error) == DW_DLV_OK) &&
-          ((tag == DW_TAG_subprogram) || (tag == DW_TAG_inlined_subroutine)) &&
-          (CheckRange(unit, current, address) != 0))
-      {
-          /*
-            Don't replace entry with found DIE:
-              dwarf_dealloc(unit->instance, *entry, DW_DLA_DIE);
-              *entry = current;
-          */
-          dwarf_dealloc(unit->instance, current, DW_DLA_DIE);
-          return 1;
-      }
+    // Only code of files is interesting
+    return
+      (permissions[2] == 'x') &&
+      (line[offset]   == '/') &&
+      ((length = strcspn(line + offset, "\n")) < PATH_MAX) &&
+      (path = strndupa(line + offset, length)) &&
+      (AddSnapshotMapping(&snapshot->list, path, start, end, position) != 0);
+  }
 
-      if (dwarf_attr(current, DW_AT_declaration, &attribute, &error) == DW_DLV_OK)
-      {
-        flag = 0;
-        dwarf_formflag(attribute, &flag, &error);
-        dwarf_dealloc(unit->instance, attribute, DW_DLA_ATTR);
+  // Line of a module list: Build ID, load base and optional path
 
-        if ((flag != 0) &&
-            (IterateOverChildren(unit, &current, address) != 0))
-        {
-          /*
-            Don't replace entry with found DIE:
-              dwarf_dealloc(unit->instance, *entry, DW_DLA_DIE);
-              *entry = current;
-          */
-          dwarf_dealloc(unit->instance, current, DW_DLA_DIE);
-          return 1;
-        }
-      }
+  if ((sscanf(line, "%128[0-9a-fA-F] %" SCNxPTR " %n", text, &start, &offset) == 2) &&
+      ((length = strlen(text)) % 2 == 0) &&
+      ((size   = strcspn(line + offset, "\n")) < PATH_MAX))
+  {
+    path = (size != 0) ? strndupa(line + offset, size) : text;
 
-#ifndef DW_LIBDWARF_VERSION
-      previous = current;
-      result   = dwarf_siblingof(unit->instance, previous, &current, &error);  // <-- Memory leak?
-#else
-      previous = current;
-      result   = dwarf_siblingof_b(unit->instance, previous, 1, &current, &error);
-#endif
+    for (size = 0; size < length / 2; size ++)
+      sscanf(text + size * 2, "%2hhx", identifier + size);
 
-      dwarf_dealloc(unit->instance, previous, DW_DLA_DIE);
-    }
-    while (result == DW_DLV_OK);
+    return AddSnapshotBase(&snapshot->list, path, identifier, size, start);
   }
 
   return 0;
 }
 
-static Dwarf_Die GetDebugEntry(struct DebugUnit* unit, uintptr_t address)
+int GetDebugSnapshotInformation(struct DebugSnapshot* snapshot, const uintptr_t* addresses, size_t count, struct DebugSourceInformation* results, size_t threads)
 {
-  Dwarf_Die entry;
-
-  Dwarf_Off offset;
-  Dwarf_Error error;
-  Dwarf_Arange arange;
+  long online;
+  size_t number;
+  uint8_t* marks;
+  struct DebugRequest* request;
+  struct DebugSegment* segment;
+  struct DebugSymbolizer symbolizer;
+
+  memset(results, 0, count * sizeof(struct DebugSourceInformation));
+  memset(&symbolizer, 0, sizeof(struct DebugSymbolizer));
+
+  symbolizer.length   = count;
+  symbolizer.number   = snapshot->list.length;
+  symbolizer.results  = results;
+  symbolizer.requests = (struct DebugRequest*)malloc(count * sizeof(struct DebugRequest) + 1);
+  symbolizer.segments = (struct DebugSegment*)malloc(symbolizer.number * sizeof(struct DebugSegment) + 1);
+  symbolizer.modules  = (struct DebugModule**)malloc(snapshot->list.count * sizeof(struct DebugModule*) + 1);
+  marks               = (uint8_t*)calloc(snapshot->list.count + 1, 1);
+
+  if ((symbolizer.requests == NULL) ||
+      (symbolizer.segments == NULL) ||
+      (symbolizer.modules  == NULL) ||
+      (marks               == NULL))
+  {
+    // Out of memory
+    free(symbolizer.requests);
+    free(symbolizer.segments);
+    free(symbolizer.modules);
+    free(marks);
+    return 0;
+  }
 
-  Dwarf_Half tag;
-  Dwarf_Unsigned low;
-  Dwarf_Unsigned high;
+  // Segments of the snapshot are sorted like the module map, open ones span up to the next segment
 
-  entry = NULL;
-  error = NULL;
+  memcpy(symbolizer.segments, snapshot->list.data, symbolizer.number * sizeof(struct DebugSegment));
+  qsort(symbolizer.segments, symbolizer.number, sizeof(struct DebugSegment), CompareSegments);
 
-  // Try to get address by aranges
+  for (segment = symbolizer.segments; segment < symbolizer.segments + symbolizer.number; segment ++)
+  {
+    segment->module = snapshot->list.modules + (uintptr_t)segment->module;
+    segment->end    = (segment->end != 0) ? segment->end : ((segment + 1 < symbolizer.segments + symbolizer.number) ? (segment + 1)->start : UINTPTR_MAX);
+  }
 
-  if (((unit->aranges != NULL) ||
-       (dwarf_get_aranges(unit->instance, &unit->aranges, &unit->count, &error) == DW_DLV_OK)) &&
-      (dwarf_get_arange(unit->aranges, unit->count, address, &arange, &error)   == DW_DLV_OK)  &&
-      (dwarf_get_cu_die_offset(arange, &offset, &error)                         == DW_DLV_OK))
+  for (request = symbolizer.requests; request < symbolizer.requests + count; request ++)
   {
-    // Result code does not matter
-    dwarf_offdie_b(unit->instance, offset, 1, &entry, &error);
+    request->address = addresses[request - symbolizer.requests];
+    request->index   = request - symbolizer.requests;
   }
 
-  // Try to find address by scanning all compilation units by a high/low PCs
+  SortDebugRequests(symbolizer.requests, count);
 
-  if (entry == NULL)
-  {
-    offset = 0;
+  // Only modules hit by requests are opened
+
+  request = symbolizer.requests;
+  segment = symbolizer.segments;
 
-    while (dwarf_next_cu_header_d(unit->instance, 1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &offset, NULL, &error) == DW_DLV_OK)
+  while ((request < symbolizer.requests + count) &&
+         (segment < symbolizer.segments + symbolizer.number))
+  {
+    if (request->address >= segment->end)
     {
-#ifndef DW_LIBDWARF_VERSION
-      if ((entry == NULL) &&  // Don't optimize a loop, cursor has to pass all compilation units
-          (dwarf_siblingof(unit->instance, NULL, &entry, &error) == DW_DLV_OK) &&
-          ((dwarf_tag(entry, &tag, &error) != DW_DLV_OK) ||
-           (tag != DW_TAG_compile_unit) ||
-           (CheckRange(unit, entry, address) == 0)))
-#else
-      if ((entry == NULL) &&
-          (dwarf_siblingof_b(unit->instance, NULL, 1, &entry, &error) == DW_DLV_OK) &&
-          ((dwarf_tag(entry, &tag, &error) != DW_DLV_OK) ||
-           (tag != DW_TAG_compile_unit) ||
-           (CheckRange(unit, entry, address) == 0)))
-#endif
-      {
-        dwarf_dealloc(unit->instance, entry, DW_DLA_DIE);
-        entry = NULL;
-      }
+      segment ++;
+      continue;
     }
+
+    if (request->address >= segment->start)
+      marks[segment->module - snapshot->list.modules] = 1;
+
+    request ++;
   }
 
-  // Try again by looking at all DIEs in all compilation units
+  for (number = 0; number < snapshot->list.count; number ++)
+    if (marks[number] != 0)
+      symbolizer.modules[symbolizer.count ++] = snapshot->list.modules + number;
 
-  if (entry == NULL)
-  {
-    offset = 0;
+  online  = sysconf(_SC_NPROCESSORS_ONLN);
+  threads = (threads != 0) ? threads : ((online > 0) ? online : 1);
 
-    while (dwarf_next_cu_header_d(unit->instance, 1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &offset, NULL, &error) == DW_DLV_OK)
-    {
-#ifndef DW_LIBDWARF_VERSION
-      if ((entry == NULL) &&  // Don't optimize a loop, cursor has to pass all compilation units
-          (dwarf_siblingof(unit->instance, NULL, &entry, &error) == DW_DLV_OK) &&
-          (IterateOverChildren(unit, &entry, address) == 0))
-#else
-      if ((entry == NULL) &&
-          (dwarf_siblingof_b(unit->instance, NULL, 1, &entry, &error) == DW_DLV_OK) &&
-          (IterateOverChildren(unit, &entry, address) == 0))
-#endif
-      {
-        dwarf_dealloc(unit->instance, entry, DW_DLA_DIE);
-        entry = NULL;
-      }
-    }
-  }
+  atomic_init(&symbolizer.next, 0);
+  RunDebugWorkers(DoOpenSnapshot, &symbolizer, symbolizer.count, threads, "Symbolizer");
+
+  // Sorted requests are split into chunks, a few per worker, to balance modules of different cost
+
+  symbolizer.chunk = count / (threads * 4) + 1;
+  symbolizer.chunk = (symbolizer.chunk > DEBUG_SYMBOLIZER_CHUNK) ? symbolizer.chunk : DEBUG_SYMBOLIZER_CHUNK;
+
+  atomic_init(&symbolizer.next, 0);
+  RunDebugWorkers(DoResolveSnapshot, &symbolizer, (count + symbolizer.chunk - 1) / symbolizer.chunk, threads, "Symbolizer");
 
-  return entry;
+  free(symbolizer.requests);
+  free(symbolizer.segments);
+  free(symbolizer.modules);
+  free(marks);
+
+  return atomic_load_explicit(&symbolizer.result, memory_order_relaxed);
 }
 
-// Code resolution
+// Fork support
 
-static struct SourceCache* GetSourceCache(struct DebugUnit* unit, Dwarf_Die entry)
+static void PrepareDebugFork()
 {
-  struct SourceCache* source;
-  struct SourceLine* last;
-  Dwarf_Unsigned version;
-  Dwarf_Error error;
-  Dwarf_Line* limit;
-  Dwarf_Line* line;
-  Dwarf_Off offset;
+  // Global state is made consistent for the child, the order follows nesting of locks elsewhere
+
+  pthread_mutex_lock(&refresher);
+  pthread_mutex_lock(&trimmer);
+  pthread_mutex_lock(&fetcher);
+  pthread_mutex_lock(&registrar);
+}
+
+static void ResumeDebugParent()
+{
+  pthread_mutex_unlock(&registrar);
+  pthread_mutex_unlock(&fetcher);
+  pthread_mutex_unlock(&trimmer);
+  pthread_mutex_unlock(&refresher);
+}
+
+static void ResetDebugState()
+{
+  struct DebugUnit* unit;
 
-  // Result code does not matter
-  dwarf_dieoffset(entry, &offset, &error);
+  // Only the calling thread survives in a child process, so everything held by other threads is released,
+  // units they were loading are opened again on demand, inherited descriptors are reopened on first use
+
+  pthread_mutex_init(&refresher, NULL);
+  pthread_mutex_init(&trimmer,   NULL);
+  pthread_mutex_init(&registrar, NULL);
+  pthread_mutex_init(&fetcher,   NULL);
+  pthread_cond_init(&fetched,    NULL);
+  pthread_mutex_init(&launcher,  NULL);
+
+  // Helper serves the parent, the child starts its own one when required
+  atomic_store_explicit(&helper, 0, memory_order_relaxed);
+
+  atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
+  memset(readers, 0, sizeof(readers));
+  atomic_flag_clear_explicit(&scratch.busy, memory_order_relaxed);
 
-  source = unit->sources;
+  fetches  = NULL;
+  fetchers = 0;
+  lineage ++;
 
-  while (source != NULL)
+  for (unit = (struct DebugUnit*)atomic_load_explicit(&cache, memory_order_acquire); unit != NULL; unit = (struct DebugUnit*)unit->next)
   {
-    if (offset == source->offset)
+    if (atomic_load_explicit(&unit->ready, memory_order_relaxed) == 0)
     {
-      dwarf_dealloc(unit->instance, entry, DW_DLA_DIE);
-      return source;
+      // Unit has been loaded by a thread of the parent, whatever it has opened is released
+      // and accounted, a table built by a thread of the parent leaves the instance usable
+      ReleaseDebugInstance(unit);
+      atomic_store_explicit(&unit->evicted, 1, memory_order_relaxed);
+      atomic_store_explicit(&unit->ready,   1, memory_order_relaxed);
     }
 
-    source = source->next;
+    pthread_mutex_init(&unit->lock, NULL);
+    pthread_mutex_init(&unit->interner, NULL);
+    atomic_store_explicit(&unit->fetching, 0, memory_order_relaxed);
   }
+}
 
-  source = (struct SourceCache*)calloc(1, sizeof(struct SourceCache));
 
-  source->entry  = entry;
-  source->offset = offset;
+static void __attribute__((constructor(104))) InitializeFork()
+{
+  // Children of pre-fork worker pools use the cache inherited from the parent
+  pthread_atfork(PrepareDebugFork, ResumeDebugParent, ResetDebugState);
+}
 
-  if ((dwarf_srclines_b(entry, &version, &source->count, &source->context, &error) == DW_DLV_OK) &&
-      (dwarf_srclines_from_linecontext(source->context, &line, &source->length, &error) == DW_DLV_OK))
-  {
-    source->list = (struct SourceLine*)calloc(source->length, sizeof(struct SourceLine));
-    limit        = line + source->length;
-    last         = source->list;
+// Out-of-process helper
 
-    while (line < limit)
-    {
-      last->line  = line; 
-      last       += (dwarf_lineaddr(*line, &last->address, &error) == DW_DLV_OK);
-      line       ++;
-    }
+static long WaitHelperEvent(atomic_uint* address, unsigned int value, long timeout)
+{
+  struct timespec time;
 
-    // Update the length with count of resolved addresses
-    source->length = last - source->list;
+  // futex is shared between processes and async-signal-safe, timeout is in milliseconds
 
-    qsort(source->list, source->length, sizeof(struct SourceLine), CompareAddresses);
-  }
+  time.tv_sec  = timeout / 1000;
+  time.tv_nsec = (timeout % 1000) * 1000000;
 
-  source->next   = unit->sources;
-  unit->sources  = source;
+  return syscall(SYS_futex, address, FUTEX_WAIT, value, &time, NULL, 0);
+}
 
-  return source;
+static void RaiseHelperEvent(atomic_uint* address)
+{
+  syscall(SYS_futex, address, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
 }
 
-int GetDebugInformation(Dl_info* information, struct link_map* map, uintptr_t address, struct DebugSourceInformation* buffer, int lock)
+static void ServeHelperRequest(struct DebugHelperSlot* slot)
 {
-  Dwarf_Die entry;
-  Dwarf_Error error;
+  struct DebugModule module;
   struct DebugUnit* unit;
-  struct SourceLine* line;
-  struct SourceLine* limit;
-  struct SourceCache* source;
-
-  if (information == NULL)
+  struct DebugIndex* index;
+  struct DebugRange* range;
+  struct SourceTable* source;
+  struct DebugSourceInformation information;
+  unsigned int current;
+
+  // Module is identified by the key sent by the main process, its address is not known here
+
+  memset(&module, 0, sizeof(struct DebugModule));
+
+  module.name   = slot->name;
+  module.device = slot->device;
+  module.inode  = slot->inode;
+  module.size   = slot->size;
+  memcpy(module.identifier, slot->identifier, slot->size);
+
+  current      = EnterDebugCache();
+  range        = NULL;
+  source       = NULL;
+  slot->result =
+    (unit  = GetDebugUnit(&module, NULL, DEBUG_GET_LOCK_WAIT)) &&
+    (CheckMissCache(unit, slot->address) == 0) &&
+    (index = GetDebugIndex(unit, DEBUG_GET_LOCK_WAIT)) &&
+    (ResolveDebugAddress(unit, index, 0, slot->address, &range, &source, &information, DEBUG_GET_LOCK_WAIT) != 0);
+
+  if (slot->result != 0)
   {
-    map         = NULL;
-    information = (Dl_info*)alloca(sizeof(Dl_info));
-    dladdr1((void*)address, information, (void**)&map, RTLD_DL_LINKMAP);
+    slot->line    = information.line;
+    slot->column  = information.column;
+    slot->address = information.address;
+    snprintf(slot->path,     DEBUG_HELPER_STRING_SIZE, "%s", (information.path     != NULL) ? information.path     : "");
+    snprintf(slot->function, DEBUG_HELPER_STRING_SIZE, "%s", (information.function != NULL) ? information.function : "");
   }
 
-  if ((map != NULL) &&
-      (unit = GetDebugUnit(information->dli_fname, client)) &&
-      (unit->instance != NULL) &&
-      (address >= map->l_addr) &&
-      ((lock == DEBUG_GET_LOCK_WAIT)      && (pthread_mutex_lock(&unit->lock)    == 0) ||
-       (lock == DEBUG_GET_LOCK_DONT_WAIT) && (pthread_mutex_trylock(&unit->lock) == 0)))
-  {
-    address -= map->l_addr;
+  LeaveDebugCache(current);
+  CheckDebugCacheBudget(DEBUG_GET_LOCK_WAIT);
+}
 
-    buffer->instance = unit->instance;
-    buffer->path     = NULL;
-    buffer->line     = 0;
-    buffer->column   = 0;
-    buffer->address  = 0;
+static void ServeHelperRing(struct DebugHelperRing* ring, pid_t parent)
+{
+  unsigned int value;
+  unsigned int expected;
+  struct DebugHelperSlot* slot;
+
+  // The only consumer of the ring, requests are served in order of claiming,
+  // the helper is reparented when the main process dies, so its parent is checked on every wake up
+
+  while ((atomic_load_explicit(&ring->state, memory_order_acquire) == DEBUG_HELPER_RUN) &&
+         (getppid() == parent))
+  {
+    value = atomic_load_explicit(&ring->counter, memory_order_acquire);
+    slot  = ring->slots + (ring->head & (DEBUG_HELPER_RING_SIZE - 1));
 
-    if ((entry  = GetDebugEntry(unit, address)) &&
-        (source = GetSourceCache(unit, entry)))
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring->head + 1)
     {
-      line  = source->list;
-      limit = source->list + source->length;
+      // Nothing to do, the state is checked again after timeout
+      WaitHelperEvent(&ring->counter, value, 1000);
+      continue;
+    }
 
-      while ((line < limit) &&
-             (line->address < address))
-      {
-        // Simply walk line-by-line
-        line ++;
-      }
+    ServeHelperRequest(slot);
 
-      if (line != limit)
-      {
-        buffer->address = line->address + map->l_addr;
-        dwarf_linesrc(*line->line, &buffer->path, &error);
-        dwarf_lineno(*line->line, &buffer->line, &error);
-        dwarf_lineoff_b(*line->line, &buffer->column, &error);
-        pthread_mutex_unlock(&unit->lock);
-        return 1;
+    expected = DEBUG_SLOT_REQUEST;
 
-      }
+    if (atomic_compare_exchange_strong_explicit(&slot->state, &expected, DEBUG_SLOT_ANSWER, memory_order_acq_rel, memory_order_acquire))
+    {
+      // Requester frees the slot when it has read the answer
+      RaiseHelperEvent(&slot->state);
+    }
+    else
+    {
+      // Requester has gone by timeout
+      atomic_store_explicit(&slot->state, DEBUG_SLOT_FREE, memory_order_relaxed);
+      atomic_store_explicit(&slot->sequence, ring->head + DEBUG_HELPER_RING_SIZE, memory_order_release);
     }
 
-    pthread_mutex_unlock(&unit->lock);
+    ring->head ++;
   }
+}
 
-  return 0;
+static void DoServe(struct DebugHelperRing* ring, pid_t parent)
+{
+  // PR_SET_PDEATHSIG is not used, it fires when the forking thread exits, not the process
+
+  prctl(PR_SET_NAME, "Symbolizer", NULL, NULL, NULL);
+
+  // The state has been reset by the atfork handler
+  ServeHelperRing(ring, parent);
+
+  _exit(EXIT_SUCCESS);
 }
 
-void ReleaseDebugInformation(struct DebugSourceInformation* information)
+static void CheckDebugHelper(struct DebugHelperRing* ring)
 {
-  if ((information->path     != NULL) &&
-      (information->instance != NULL))
+  int error;
+  pid_t result;
+  uintptr_t expected;
+
+  // Called when a request has failed, async-signal-safe, a dead helper never frees claimed slots,
+  // so its ring is detached and StartDebugHelper() could start another helper,
+  // the child might be reaped already by a handler of SIGCHLD of the process
+
+  error  = errno;
+  result = waitpid(ring->child, NULL, WNOHANG);
+
+  if ((result == ring->child) ||
+      (result < 0) && (kill(ring->child, 0) < 0) && (errno == ESRCH))
   {
-    // https://chromium.googlesource.com/external/elfutils/+/elfutils-0.142/libdwarf/dwarf_dealloc.c
-    dwarf_dealloc(information->instance, information->path, DW_DLA_STRING);
+    atomic_store_explicit(&ring->state, DEBUG_HELPER_STOP, memory_order_release);
+    expected = (uintptr_t)ring;
+    atomic_compare_exchange_strong_explicit(&helper, &expected, 0, memory_order_acq_rel, memory_order_relaxed);
   }
-}
 
-// Unit preloading
+  errno = error;
+}
 
-static void AppendNameList(struct NameList* list, const char* name)
+int StartDebugHelper()
 {
-  int length;
+  int result;
+  pid_t parent;
+  pid_t child;
+  size_t number;
+  struct DebugHelperRing* ring;
 
-  length = strlen(name) + 1;
+  // fork() is used instead of clone() like in WatchPoint, since the helper uses heap and libraries,
+  // so their locks have to be prepared by atfork handlers
 
-  if ((list->length + length + 1) > list->size)
+  pthread_mutex_lock(&launcher);
+
+  result = 0;
+  ring   = (struct DebugHelperRing*)atomic_load_explicit(&helper, memory_order_relaxed);
+
+  if (ring == NULL)
   {
-    list->size += length + PATH_MAX;
-    list->data  = (char*)realloc(list->data, list->size);
-  }
+    ring = (struct DebugHelperRing*)mmap(NULL, sizeof(struct DebugHelperRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (ring == MAP_FAILED)
+    {
+      result = errno;
+      pthread_mutex_unlock(&launcher);
+      return result;
+    }
+
+    for (number = 0; number < DEBUG_HELPER_RING_SIZE; number ++)
+      atomic_init(&ring->slots[number].sequence, number);
 
-  memcpy(list->data + list->length, name, length);
+    atomic_init(&ring->state, DEBUG_HELPER_RUN);
 
-  list->length += length;
-  list->data[list->length] = '\0';
+    // Module map is prepared in advance, it is the only data used by requests
+
+    RefreshDebugArena(DEBUG_GET_LOCK_WAIT);
+
+    parent = getpid();
+
+    switch (child = fork())
+    {
+      case -1:
+        result = errno;
+        munmap(ring, sizeof(struct DebugHelperRing));
+        break;
+
+      case 0:
+        DoServe(ring, parent);
+        break;
+
+      default:
+        ring->child = child;
+        atomic_store_explicit(&helper, (uintptr_t)ring, memory_order_release);
+        break;
+    }
+  }
+
+  pthread_mutex_unlock(&launcher);
+  return result;
 }
 
-static int HandleProgramHeader(struct dl_phdr_info* information, size_t size, void* data)
+void StopDebugHelper()
 {
-  struct stat status;
+  struct DebugHelperRing* ring;
+
+  pthread_mutex_lock(&launcher);
 
-  if ((*information->dlpi_name != '\0') &&
-      (stat(information->dlpi_name, &status) == 0))
+  if (ring = (struct DebugHelperRing*)atomic_exchange_explicit(&helper, 0, memory_order_acq_rel))
   {
-    // Retreive units with accessible path only
-    AppendNameList((struct NameList*)data, information->dlpi_name);
+    atomic_store_explicit(&ring->state, DEBUG_HELPER_STOP, memory_order_release);
+    atomic_fetch_add_explicit(&ring->counter, 1, memory_order_release);
+    RaiseHelperEvent(&ring->counter);
+    waitpid(ring->child, NULL, 0);
+
+    // Requesters which still wait for answers get timeouts, so the ring is kept
   }
 
-  return 0;
+  pthread_mutex_unlock(&launcher);
 }
 
-static void TryUpdateDebugCache(debuginfod_client* client)
+int GetDebugHelperInformation(uintptr_t address, struct DebugHelperInformation* buffer, int timeout, int lock)
 {
-  struct NameList list;
-  char* name;
-
-  list.data   = NULL;
-  list.size   = 0;
-  list.length = 0;
+  long time;
+  int result;
+  size_t position;
+  size_t sequence;
+  uintptr_t base;
+  unsigned int period;
+  unsigned int expected;
+  struct timespec now;
+  struct timespec limit;
+  struct DebugArena* current;
+  struct DebugSegment* segment;
+  struct DebugHelperRing* ring;
+  struct DebugHelperSlot* slot;
+
+  // Only the module map is used in the process, the request is async-signal-safe in DEBUG_GET_SIGNAL_SAFE mode,
+  // the arena is used inside the cache until the request is written
+
+  period  = EnterDebugCache();
+  current = (lock == DEBUG_GET_SIGNAL_SAFE) ?
+    (struct DebugArena*)atomic_load_explicit(&arena, memory_order_acquire) :
+    RefreshDebugArena(lock);
+
+  if (((ring    = (struct DebugHelperRing*)atomic_load_explicit(&helper, memory_order_acquire)) == NULL) ||
+      ((segment = FindDebugSegment(current, address)) == NULL) ||
+      (segment->module->name == NULL) ||
+      (strlen(segment->module->name) >= DEBUG_HELPER_NAME_SIZE))
+  {
+    // Helper is not running or module is unknown
+    LeaveDebugCache(period);
+    return 0;
+  }
 
-  name = (char*)alloca(PATH_MAX);
-  memset(name, 0, PATH_MAX);
-  readlink("/proc/self/exe", name, PATH_MAX);
-  AppendNameList(&list, name);
+  // Claim a slot, the ring is a bounded queue of Dmitry Vyukov with many producers
 
-  dl_iterate_phdr(HandleProgramHeader, &list);
+  position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
 
-  for (name = list.data; *name != '\0'; name += strlen(name) + 1)
+  while (1)
   {
-    // Retreive units slowly
-    GetDebugUnit(name, client);
-  }
+    slot     = ring->slots + (position & (DEBUG_HELPER_RING_SIZE - 1));
+    sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
 
-  free(list.data);
-}
+    if ((sequence == position) &&
+        (atomic_compare_exchange_weak_explicit(&ring->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed)))
+      break;
 
-static int HandleLoadProgress(debuginfod_client* client, long value1, long value2)
-{
-  return atomic_load_explicit(&state, memory_order_relaxed) != DEBUG_UPDATE_ASYNCHRONOUS;
-}
+    if ((intptr_t)(sequence - position) < 0)
+    {
+      // Ring is full, helper is busy or dead
+      LeaveDebugCache(period);
+      CheckDebugHelper(ring);
+      return 0;
+    }
 
-static void* DoWork(void* argument)
-{
-  debuginfod_client* client;
-  pthread_t thread;
+    if (sequence != position)
+      position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  }
 
-  thread = pthread_self();
-  client = debuginfod_begin();
+  base          = segment->base;
+  slot->address = address - base;
+  slot->device  = segment->module->device;
+  slot->inode   = segment->module->inode;
+  slot->size    = segment->module->size;
+  memcpy(slot->identifier, segment->module->identifier, segment->module->size);
+  strcpy(slot->name, segment->module->name);
 
-  pthread_setname_np(thread, "Loader");
-  debuginfod_set_progressfn(client, HandleLoadProgress);
+  LeaveDebugCache(period);
 
-  TryUpdateDebugCache(client);
-  atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
+  atomic_store_explicit(&slot->state, DEBUG_SLOT_REQUEST, memory_order_relaxed);
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+  atomic_fetch_add_explicit(&ring->counter, 1, memory_order_release);
+  RaiseHelperEvent(&ring->counter);
 
-  debuginfod_end(client);
-  pthread_detach(thread);
-  return NULL;
-}
+  // Wait for the answer, clock_gettime() is async-signal-safe as well
 
-void UpdateDebugCache(int option)
-{
-  pthread_t thread;
+  clock_gettime(CLOCK_MONOTONIC, &limit);
+  limit.tv_sec  += timeout / 1000;
+  limit.tv_nsec += (timeout % 1000) * 1000000;
 
-  if (option == DEBUG_UPDATE_SYNCHRONOUS)
+  while (atomic_load_explicit(&slot->state, memory_order_acquire) == DEBUG_SLOT_REQUEST)
   {
-    TryUpdateDebugCache(client);
-    return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time = (limit.tv_sec - now.tv_sec) * 1000 + (limit.tv_nsec - now.tv_nsec) / 1000000;
+
+    if (time <= 0)
+    {
+      expected = DEBUG_SLOT_REQUEST;
+
+      if (atomic_compare_exchange_strong_explicit(&slot->state, &expected, DEBUG_SLOT_ABANDONED, memory_order_acq_rel, memory_order_acquire))
+      {
+        // Helper frees the slot when it's done, unless it's dead
+        CheckDebugHelper(ring);
+        return 0;
+      }
+
+      break;
+    }
+
+    WaitHelperEvent(&slot->state, DEBUG_SLOT_REQUEST, time);
   }
 
-  if ((option == DEBUG_UPDATE_ASYNCHRONOUS) &&
-      (atomic_exchange_explicit(&state, DEBUG_UPDATE_ASYNCHRONOUS, memory_order_relaxed) == DEBUG_UPDATE_SYNCHRONOUS) &&
-      (pthread_create(&thread, NULL, DoWork, NULL) != 0))
+  if (result = slot->result)
   {
-    atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
-    return;
+    buffer->address = slot->address + base;
+    buffer->line    = slot->line;
+    buffer->column  = slot->column;
+    memcpy(buffer->path,     slot->path,     DEBUG_HELPER_STRING_SIZE);
+    memcpy(buffer->function, slot->function, DEBUG_HELPER_STRING_SIZE);
   }
-}
 
-void CancelUpdateDebugCache()
-{
-  atomic_store_explicit(&state, DEBUG_UPDATE_SYNCHRONOUS, memory_order_relaxed);
+  atomic_store_explicit(&slot->state, DEBUG_SLOT_FREE, memory_order_relaxed);
+  atomic_store_explicit(&slot->sequence, position + DEBUG_HELPER_RING_SIZE, memory_order_release);
+
+  return result;
 }
@@ -19,24 +19,119 @@ extern "C"
 
 #define DEBUG_UPDATE_SYNCHRONOUS   0
 #define DEBUG_UPDATE_ASYNCHRONOUS  1
+#define DEBUG_UPDATE_SHARED        2  // Synchronous, then indexes are moved to shared mappings before fork()
 
 #define DEBUG_GET_LOCK_WAIT       0
 #define DEBUG_GET_LOCK_DONT_WAIT  1
+#define DEBUG_GET_SIGNAL_SAFE     2
+
+#define DEBUG_TIER_OPEN     0  // Opening of module and its DWARF
+#define DEBUG_TIER_INDEX    1  // Address index of module
+#define DEBUG_TIER_SOURCE   2  // Line and frame tables of compilation units
+#define DEBUG_TIER_SYMBOLS  3  // Symbol table
+#define DEBUG_TIER_FETCH    4  // Downloads from debuginfod
+#define DEBUG_TIER_COUNT    5
+
+#define DEBUG_HELPER_STRING_SIZE  512
 
 struct DebugSourceInformation
 {
-  char* path;
+  const char* path;
+  const char* function;
+  uint32_t file;
   uintptr_t address;
   Dwarf_Unsigned line;
   Dwarf_Unsigned column;
   Dwarf_Debug instance;
 };
 
+struct DebugSymbolInformation
+{
+  const char* name;
+  const char* mangled;
+  uintptr_t address;
+  size_t size;
+};
+
+struct DebugCounters
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t aranges;
+  uint64_t scans;
+  uint64_t walks;
+  uint64_t contentions;
+  uint64_t fetches;
+  uint64_t failures;
+  uint64_t negatives;
+  uint64_t times[DEBUG_TIER_COUNT];
+};
+
+struct DebugCacheStatistics
+{
+  size_t usage;
+  size_t limit;
+  struct DebugCounters counters;
+};
+
+struct DebugUnitStatistics
+{
+  const char* name;
+  size_t usage;
+  struct DebugCounters counters;
+};
+
+struct DebugFrameInformation
+{
+  uintptr_t address;                      // Instruction pointer of the frame
+  const char* module;                     // Path of the module, NULL when unknown
+  uintptr_t base;                         // Load bias of the module
+  const char* symbol;                     // Function from the symbol table, NULL when unknown
+  uintptr_t offset;                       // Offset of the address in the function
+  struct DebugSourceInformation source;   // The innermost source location, path is NULL when unknown
+};
+
+struct DebugSnapshot;
+
+struct DebugHelperInformation
+{
+  uintptr_t address;
+  uint64_t line;
+  uint64_t column;
+  char path[DEBUG_HELPER_STRING_SIZE];
+  char function[DEBUG_HELPER_STRING_SIZE];
+};
+
 int GetDebugInformation(Dl_info* information, struct link_map* map, uintptr_t address, struct DebugSourceInformation* buffer, int lock);
+int GetDebugInformationChain(uintptr_t address, struct DebugSourceInformation* chain, size_t count, int lock);
+int GetDebugInformationBatch(const uintptr_t* addresses, size_t count, struct DebugSourceInformation* results, int lock);
+int GetDebugSymbol(uintptr_t address, struct DebugSymbolInformation* buffer, int lock);
 void ReleaseDebugInformation(struct DebugSourceInformation* information);
+const char* GetDebugFilePath(uint32_t file);
+size_t GetDebugFileList(const char** list, size_t count);
 
 void UpdateDebugCache(int option);
 void CancelUpdateDebugCache();
+int GetDebugCacheProgress(size_t* count, size_t* total);
+void SetDebugCacheDirectory(const char* path);
+unsigned int GetDebugCacheRevision();
+void SetDebugCacheLimit(size_t size);
+void TrimDebugCache(size_t size);
+void GetDebugCacheStatistics(struct DebugCacheStatistics* statistics);
+size_t GetDebugUnitStatistics(struct DebugUnitStatistics* list, size_t count);
+
+size_t GetDebugBacktrace(void* context, struct DebugFrameInformation* frames, size_t depth, size_t skip, int lock);
+size_t FormatDebugBacktrace(void* context, char* buffer, size_t size, size_t depth, size_t skip, int lock);
+
+struct DebugSnapshot* CreateDebugSnapshot();
+void ReleaseDebugSnapshot(struct DebugSnapshot* snapshot);
+int AddDebugSnapshotLine(struct DebugSnapshot* snapshot, const char* line);
+int GetDebugSnapshotInformation(struct DebugSnapshot* snapshot, const uintptr_t* addresses, size_t count, struct DebugSourceInformation* results, size_t threads);
+
+int StartDebugHelper();
+void StopDebugHelper();
+int GetDebugHelperInformation(uintptr_t address, struct DebugHelperInformation* buffer, int timeout, int lock);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,541 @@
+// Benchmark of DebugDecoder
+//
+// Build:  cc -O2 -o DebugDecoderBenchmark DebugDecoderBenchmark.c DebugDecoder.c -ldwarf -lelf -ldebuginfod -lunwind -lpthread -ldl
+// Usage:  DebugDecoderBenchmark [-u units] [-f functions] [-r rounds] [-t threads]
+//
+// Synthetic shared objects are compiled at runtime by cc and objcopy in a temporary directory:
+// - aranges     - compilation units are indexed by .debug_aranges
+// - no-aranges  - .debug_aranges are removed, ranges are collected from DIEs
+// - split       - stripped object, DWARF is served by a file:// stand-in of debuginfod
+
+#include "DebugDecoder.h"
+
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define BENCHMARK_WAIT_LIMIT  60  // Seconds to wait for a background download
+
+struct BenchmarkWorker
+{
+  pthread_t thread;
+  pthread_barrier_t* barrier;
+  const uintptr_t* addresses;
+  size_t count;
+  size_t rounds;
+};
+
+struct BenchmarkVariant
+{
+  const char* name;
+  const char* command;  // Post-processing of the linked object, %1$s is the directory, %2$s is Build ID
+};
+
+static const struct BenchmarkVariant variants[] =
+{
+  { "aranges",    NULL },
+  { "no-aranges", "objcopy --remove-section=.debug_aranges %1$s/no-aranges.so" },
+  { "split",      "objcopy --only-keep-debug %1$s/split.so %1$s/split.debug && objcopy --strip-debug %1$s/split.so && "
+                  "mkdir -p %1$s/debuginfod/buildid/%2$s && mv %1$s/split.debug %1$s/debuginfod/buildid/%2$s/debuginfo" },
+  { NULL,         NULL }
+};
+
+static uint64_t GetTime()
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static size_t GetResidentSize()
+{
+  FILE* file;
+  size_t size;
+  size_t resident;
+
+  resident = 0;
+
+  if (file = fopen("/proc/self/statm", "r"))
+  {
+    if (fscanf(file, "%zu %zu", &size, &resident) != 2)
+      resident = 0;
+
+    fclose(file);
+  }
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int CompareTimes(const void* value1, const void* value2)
+{
+  uint64_t time1;
+  uint64_t time2;
+
+  time1 = *(const uint64_t*)value1;
+  time2 = *(const uint64_t*)value2;
+
+  return (time1 > time2) - (time1 < time2);
+}
+
+static int RunCommand(const char* format, ...)
+{
+  va_list arguments;
+  char command[8192];
+
+  va_start(arguments, format);
+  vsnprintf(command, sizeof(command), format, arguments);
+  va_end(arguments);
+
+  if (system(command) != 0)
+  {
+    fprintf(stderr, "Command failed: %s\n", command);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Synthetic objects
+
+static int WriteSources(const char* directory, size_t units, size_t functions)
+{
+  FILE* file;
+  size_t unit;
+  size_t number;
+  char path[PATH_MAX];
+
+  // Every function calls an always inlined helper, so chains of inlined frames are present too
+
+  for (unit = 0; unit < units; unit ++)
+  {
+    snprintf(path, PATH_MAX, "%s/unit%zu.c", directory, unit);
+
+    if ((file = fopen(path, "w")) == NULL)
+      return 0;
+
+    for (number = 0; number < functions; number ++)
+    {
+      fprintf(file,
+        "static inline __attribute__((always_inline)) int Helper%zu_%zu(int value)\n"
+        "{\n"
+        "  return value * %zu + 1;\n"
+        "}\n"
+        "\n"
+        "int Function%zu_%zu(int value)\n"
+        "{\n"
+        "  int result;\n"
+        "\n"
+        "  result = Helper%zu_%zu(value);\n"
+        "\n"
+        "  if (result & 1)\n"
+        "    result ^= %zu;\n"
+        "\n"
+        "  return result;\n"
+        "}\n"
+        "\n",
+        unit, number, number + 3, unit, number, unit, number, unit * functions + number);
+    }
+
+    fclose(file);
+  }
+
+  snprintf(path, PATH_MAX, "%s/table.c", directory);
+
+  if ((file = fopen(path, "w")) == NULL)
+    return 0;
+
+  fprintf(file, "#include <stddef.h>\n\n");
+
+  for (unit = 0; unit < units; unit ++)
+    for (number = 0; number < functions; number ++)
+      fprintf(file, "int Function%zu_%zu(int value);\n", unit, number);
+
+  fprintf(file, "\nvoid* const SyntheticFunctions[] =\n{\n");
+
+  for (unit = 0; unit < units; unit ++)
+    for (number = 0; number < functions; number ++)
+      fprintf(file, "  (void*)Function%zu_%zu,\n", unit, number);
+
+  fprintf(file, "};\n\nconst size_t SyntheticCount = %zu;\n", units * functions);
+  fclose(file);
+
+  return 1;
+}
+
+static void MakeBuildID(char* identifier)
+{
+  size_t number;
+
+  // Random Build ID, so neither persistent index nor debuginfod client cache of previous runs is used
+
+  for (number = 0; number < 20; number ++)
+    sprintf(identifier + number * 2, "%02x", rand() & 0xff);
+}
+
+static int BuildVariant(const char* directory, const struct BenchmarkVariant* variant, char* identifier)
+{
+  MakeBuildID(identifier);
+
+  return
+    RunCommand("cc -shared -o %s/%s.so %s/*.o -Wl,--build-id=0x%s", directory, variant->name, directory, identifier) &&
+    ((variant->command == NULL) || RunCommand(variant->command, directory, identifier));
+}
+
+// Measurements
+
+static void* DoResolve(void* argument)
+{
+  struct BenchmarkWorker* worker;
+  struct DebugSourceInformation information;
+  size_t round;
+  size_t number;
+
+  worker = (struct BenchmarkWorker*)argument;
+
+  pthread_barrier_wait(worker->barrier);
+
+  for (round = 0; round < worker->rounds; round ++)
+    for (number = 0; number < worker->count; number ++)
+      GetDebugInformation(NULL, NULL, worker->addresses[number], &information, DEBUG_GET_LOCK_WAIT);
+
+  return NULL;
+}
+
+static uint64_t MeasureColdLookup(uintptr_t address, int* result)
+{
+  uint64_t start;
+  uint64_t limit;
+  struct DebugSourceInformation information;
+
+  // Downloads are done in background, so lookup is repeated until the data arrives
+
+  start = GetTime();
+  limit = start + BENCHMARK_WAIT_LIMIT * 1000000000ULL;
+
+  while (((*result = GetDebugInformation(NULL, NULL, address, &information, DEBUG_GET_LOCK_WAIT)) == 0) &&
+         (GetTime() < limit))
+    usleep(1000);
+
+  return GetTime() - start;
+}
+
+static void MeasureWarmLookups(const uintptr_t* addresses, size_t count, size_t rounds)
+{
+  uint64_t* times;
+  uint64_t start;
+  size_t round;
+  size_t number;
+  size_t resolved;
+  struct DebugSourceInformation information;
+
+  if ((times = (uint64_t*)malloc(count * rounds * sizeof(uint64_t))) == NULL)
+    return;
+
+  resolved = 0;
+
+  for (round = 0; round < rounds; round ++)
+  {
+    for (number = 0; number < count; number ++)
+    {
+      start     = GetTime();
+      resolved += GetDebugInformation(NULL, NULL, addresses[number], &information, DEBUG_GET_LOCK_WAIT);
+      times[round * count + number] = GetTime() - start;
+    }
+  }
+
+  qsort(times, count * rounds, sizeof(uint64_t), CompareTimes);
+
+  printf("  warm lookup:  p50 %llu ns, p99 %llu ns, max %llu ns, resolved %zu of %zu\n",
+    (unsigned long long)times[count * rounds / 2],
+    (unsigned long long)times[count * rounds * 99 / 100],
+    (unsigned long long)times[count * rounds - 1],
+    resolved, count * rounds);
+
+  free(times);
+}
+
+static void MeasureBatch(const uintptr_t* addresses, size_t count, size_t rounds)
+{
+  uint64_t time;
+  size_t round;
+  size_t resolved;
+  struct DebugSourceInformation* results;
+
+  if ((results = (struct DebugSourceInformation*)malloc(count * sizeof(struct DebugSourceInformation))) == NULL)
+    return;
+
+  resolved = 0;
+  time     = GetTime();
+
+  for (round = 0; round < rounds; round ++)
+    resolved += GetDebugInformationBatch(addresses, count, results, DEBUG_GET_LOCK_WAIT);
+
+  time = GetTime() - time;
+
+  printf("  batch:        %.0f addresses/s, resolved %zu of %zu\n", (double)count * rounds * 1e9 / time, resolved, count * rounds);
+
+  free(results);
+}
+
+static void MeasureContention(const uintptr_t* addresses, size_t count, size_t rounds, size_t limit)
+{
+  struct BenchmarkWorker* workers;
+  pthread_barrier_t barrier;
+  uint64_t time;
+  size_t threads;
+  size_t number;
+
+  if ((workers = (struct BenchmarkWorker*)calloc(limit, sizeof(struct BenchmarkWorker))) == NULL)
+    return;
+
+  for (threads = 1; threads <= limit; threads *= 2)
+  {
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+
+    for (number = 0; number < threads; number ++)
+    {
+      workers[number].barrier   = &barrier;
+      workers[number].addresses = addresses;
+      workers[number].count     = count;
+      workers[number].rounds    = rounds;
+      pthread_create(&workers[number].thread, NULL, DoResolve, workers + number);
+    }
+
+    pthread_barrier_wait(&barrier);
+    time = GetTime();
+
+    for (number = 0; number < threads; number ++)
+      pthread_join(workers[number].thread, NULL);
+
+    time = GetTime() - time;
+    pthread_barrier_destroy(&barrier);
+
+    printf("  %2zu threads:   %.0f lookups/s\n", threads, (double)count * rounds * threads * 1e9 / time);
+  }
+
+  free(workers);
+}
+
+static void PrintMemory(const char* title)
+{
+  struct DebugCacheStatistics statistics;
+
+  GetDebugCacheStatistics(&statistics);
+  printf("  %-13s RSS %zu KiB, cache %zu KiB\n", title, GetResidentSize() / 1024, statistics.usage / 1024);
+}
+
+static void PrintCounters()
+{
+  struct DebugCacheStatistics statistics;
+
+  GetDebugCacheStatistics(&statistics);
+
+  printf("  counters:     hits %llu, misses %llu, aranges %llu, scans %llu, walks %llu, contentions %llu, fetches %llu, failures %llu\n",
+    (unsigned long long)statistics.counters.hits,    (unsigned long long)statistics.counters.misses,
+    (unsigned long long)statistics.counters.aranges, (unsigned long long)statistics.counters.scans,
+    (unsigned long long)statistics.counters.walks,   (unsigned long long)statistics.counters.contentions,
+    (unsigned long long)statistics.counters.fetches, (unsigned long long)statistics.counters.failures);
+
+  printf("  times:        open %.3f ms, index %.3f ms, source %.3f ms, symbols %.3f ms, fetch %.3f ms\n",
+    statistics.counters.times[DEBUG_TIER_OPEN]    / 1e6, statistics.counters.times[DEBUG_TIER_INDEX]  / 1e6,
+    statistics.counters.times[DEBUG_TIER_SOURCE]  / 1e6, statistics.counters.times[DEBUG_TIER_SYMBOLS] / 1e6,
+    statistics.counters.times[DEBUG_TIER_FETCH]   / 1e6);
+}
+
+static void* RunVariant(const char* directory, const struct BenchmarkVariant* variant, size_t rounds, size_t threads)
+{
+  void* handle;
+  void* const* functions;
+  const size_t* count;
+  uintptr_t* addresses;
+  char path[PATH_MAX];
+  uint64_t time;
+  size_t number;
+  int result;
+
+  snprintf(path, PATH_MAX, "%s/%s.so", directory, variant->name);
+
+  if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL)
+  {
+    fprintf(stderr, "Cannot load %s: %s\n", path, dlerror());
+    return NULL;
+  }
+
+  if (((functions = (void* const*)dlsym(handle, "SyntheticFunctions")) == NULL) ||
+      ((count     = (const size_t*)dlsym(handle, "SyntheticCount")) == NULL) ||
+      ((addresses = (uintptr_t*)malloc(*count * 2 * sizeof(uintptr_t))) == NULL))
+  {
+    fprintf(stderr, "Cannot use %s\n", path);
+    dlclose(handle);
+    return NULL;
+  }
+
+  // Entry points and addresses inside of functions are resolved
+
+  for (number = 0; number < *count; number ++)
+  {
+    addresses[number * 2 + 0] = (uintptr_t)functions[number];
+    addresses[number * 2 + 1] = (uintptr_t)functions[number] + 4;
+  }
+
+  printf("%s (%zu addresses)\n", variant->name, *count * 2);
+  PrintMemory("before:");
+
+  time = MeasureColdLookup(addresses[*count], &result);
+  printf("  cold lookup:  %.3f ms%s\n", time / 1e6, (result != 0) ? "" : " (not resolved)");
+
+  MeasureWarmLookups(addresses, *count * 2, rounds);
+  MeasureBatch(addresses, *count * 2, rounds);
+  MeasureContention(addresses, *count * 2, rounds, threads);
+  PrintMemory("after:");
+
+  // Evicted module is opened again
+
+  TrimDebugCache(0);
+  time = MeasureColdLookup(addresses[*count], &result);
+  printf("  reload:       %.3f ms%s\n", time / 1e6, (result != 0) ? "" : " (not resolved)");
+
+  // Module stays loaded for the lookup from the persistent index
+
+  free(addresses);
+  return handle;
+}
+
+static size_t GetPreloadCount()
+{
+  size_t count;
+  size_t total;
+
+  GetDebugCacheProgress(&count, &total);
+  return total;
+}
+
+static void RunPersistentLookup(void* handle, const struct BenchmarkVariant* variant)
+{
+  void* const* functions;
+  uint64_t time;
+  int result;
+
+  if ((handle    != NULL) &&
+      (functions  = (void* const*)dlsym(handle, "SyntheticFunctions")))
+  {
+    time = MeasureColdLookup((uintptr_t)functions[0], &result);
+    printf("%s\n  persistent:   %.3f ms%s\n", variant->name, time / 1e6, (result != 0) ? "" : " (not resolved)");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const struct BenchmarkVariant* variant;
+  void* handles[sizeof(variants) / sizeof(variants[0])];
+  char directory[PATH_MAX];
+  char identifier[41];
+  char path[PATH_MAX];
+  size_t functions;
+  size_t threads;
+  size_t rounds;
+  size_t units;
+  uint64_t duration;
+  int option;
+
+  units     = 64;
+  functions = 64;
+  rounds    = 16;
+  threads   = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((option = getopt(argc, argv, "u:f:r:t:")) != -1)
+  {
+    switch (option)
+    {
+      case 'u':  units     = strtoul(optarg, NULL, 10);  break;
+      case 'f':  functions = strtoul(optarg, NULL, 10);  break;
+      case 'r':  rounds    = strtoul(optarg, NULL, 10);  break;
+      case 't':  threads   = strtoul(optarg, NULL, 10);  break;
+      default:   units     = 0;                           break;
+    }
+  }
+
+  if ((units     < 1) ||
+      (functions < 1) ||
+      (rounds    < 1) ||
+      (threads   < 1))
+  {
+    // Percentiles need at least one sample of at least one address, contention needs at least one thread
+    fprintf(stderr, "Usage: %s [-u units] [-f functions] [-r rounds] [-t threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  srand(time(NULL) ^ getpid());
+  strcpy(directory, "/tmp/DebugDecoderBenchmark.XXXXXX");
+
+  if (mkdtemp(directory) == NULL)
+  {
+    fprintf(stderr, "Cannot create temporary directory: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  // debuginfod client reads the environment when it's created, so it has to be set before any lookup
+
+  snprintf(path, PATH_MAX, "file://%s/debuginfod", directory);
+  setenv("DEBUGINFOD_URLS", path, 1);
+  snprintf(path, PATH_MAX, "%s/client", directory);
+  setenv("DEBUGINFOD_CACHE_PATH", path, 1);
+  snprintf(path, PATH_MAX, "%s/index", directory);
+  SetDebugCacheDirectory(path);
+
+  printf("%zu units, %zu functions per unit, %zu rounds, up to %zu threads\n", units, functions, rounds, threads);
+
+  if ((WriteSources(directory, units, functions) == 0) ||
+      (RunCommand("cd %s && cc -c -g -O1 -fPIC unit*.c table.c", directory) == 0))
+  {
+    RunCommand("rm -rf %s", directory);
+    return EXIT_FAILURE;
+  }
+
+  for (variant = variants; variant->name != NULL; variant ++)
+  {
+    handles[variant - variants] = NULL;
+
+    if (BuildVariant(directory, variant, identifier) != 0)
+      handles[variant - variants] = RunVariant(directory, variant, rounds, threads);
+  }
+
+  // Preload of all modules of the process, it stores the persistent index too
+
+  TrimDebugCache(0);
+
+  duration = GetTime();
+  UpdateDebugCache(DEBUG_UPDATE_SYNCHRONOUS);
+  duration = GetTime() - duration;
+
+  printf("preload (%zu modules)\n  time:         %.3f ms\n", GetPreloadCount(), duration / 1e6);
+  PrintMemory("after:");
+
+  PrintCounters();
+
+  // Modules are opened again from the persistent index stored by preload
+
+  TrimDebugCache(0);
+
+  for (variant = variants; variant->name != NULL; variant ++)
+    RunPersistentLookup(handles[variant - variants], variant);
+
+  for (variant = variants; variant->name != NULL; variant ++)
+  {
+    if (handles[variant - variants] != NULL)
+      dlclose(handles[variant - variants]);
+  }
+
+  RunCommand("rm -rf %s", directory);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+// Offline symbolizer of DebugDecoder
+//
+// Build:  cc -O2 -o DebugSymbolizer DebugSymbolizer.c DebugDecoder.c -ldwarf -lelf -ldebuginfod -lunwind -lpthread -ldl
+// Usage:  DebugSymbolizer [-t threads] [-c directory] snapshot [addresses]
+//
+// Snapshot is a copy of /proc/<pid>/maps or a list of lines "<Build ID> <load base> [path]" (both could be mixed),
+// addresses are whitespace-separated hexadecimal numbers read from the file or standard input, other words are skipped.
+// Every address is printed on its own line in the order of input: address function path:line:column
+
+#include "DebugDecoder.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+static int LoadSnapshot(struct DebugSnapshot* snapshot, const char* path)
+{
+  FILE* file;
+  char* line;
+  size_t size;
+  int count;
+
+  if ((file = fopen(path, "r")) == NULL)
+  {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  line  = NULL;
+  size  = 0;
+  count = 0;
+
+  while (getline(&line, &size, file) > 0)
+    count += AddDebugSnapshotLine(snapshot, line);
+
+  free(line);
+  fclose(file);
+  return count;
+}
+
+static uintptr_t* LoadAddresses(FILE* file, size_t* count)
+{
+  char* last;
+  char word[64];
+  size_t size;
+  uintptr_t* data;
+  uintptr_t* addresses;
+  unsigned long long value;
+
+  addresses = NULL;
+  size      = 0;
+  *count    = 0;
+
+  while (fscanf(file, "%63s", word) == 1)
+  {
+    errno = 0;
+    value = strtoull(word, &last, 16);
+
+    if ((*last != '\0') ||
+        (errno != 0))
+    {
+      // Not an address
+      continue;
+    }
+
+    if ((*count == size) &&
+        (data = (uintptr_t*)realloc(addresses, (size + 65536) * sizeof(uintptr_t))))
+    {
+      addresses = data;
+      size     += 65536;
+    }
+
+    if (*count == size)
+    {
+      // Out of memory
+      break;
+    }
+
+    addresses[(*count) ++] = (uintptr_t)value;
+  }
+
+  return addresses;
+}
+
+int main(int argc, char** argv)
+{
+  int option;
+  int result;
+  size_t count;
+  size_t number;
+  size_t threads;
+  uintptr_t* addresses;
+  struct DebugSnapshot* snapshot;
+  struct DebugSourceInformation* results;
+  struct DebugSourceInformation* information;
+  FILE* file;
+
+  threads = 0;
+
+  while ((option = getopt(argc, argv, "t:c:")) != -1)
+  {
+    switch (option)
+    {
+      case 't':
+        threads = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'c':
+        SetDebugCacheDirectory(optarg);
+        break;
+
+      default:
+        fprintf(stderr, "Usage: %s [-t threads] [-c directory] snapshot [addresses]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    fprintf(stderr, "Usage: %s [-t threads] [-c directory] snapshot [addresses]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((snapshot = CreateDebugSnapshot()) == NULL ||
+      (LoadSnapshot(snapshot, argv[optind]) <= 0))
+  {
+    fprintf(stderr, "No modules found in %s\n", argv[optind]);
+    ReleaseDebugSnapshot(snapshot);
+    return EXIT_FAILURE;
+  }
+
+  file = (optind + 1 < argc) ? fopen(argv[optind + 1], "r") : stdin;
+
+  if (file == NULL)
+  {
+    fprintf(stderr, "Cannot open %s: %s\n", argv[optind + 1], strerror(errno));
+    ReleaseDebugSnapshot(snapshot);
+    return EXIT_FAILURE;
+  }
+
+  addresses = LoadAddresses(file, &count);
+  results   = (struct DebugSourceInformation*)malloc(count * sizeof(struct DebugSourceInformation) + 1);
+
+  if (file != stdin)
+  {
+    // Result does not matter
+    fclose(file);
+  }
+
+  if (results == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    ReleaseDebugSnapshot(snapshot);
+    free(addresses);
+    return EXIT_FAILURE;
+  }
+
+  result = GetDebugSnapshotInformation(snapshot, addresses, count, results, threads);
+
+  for (number = 0; number < count; number ++)
+  {
+    information = results + number;
+
+    if (information->path != NULL)
+    {
+      printf("%#" PRIxPTR " %s %s:%llu:%llu\n", addresses[number],
+        (information->function != NULL) ? information->function : "??", information->path,
+        (unsigned long long)information->line, (unsigned long long)information->column);
+      continue;
+    }
+
+    printf("%#" PRIxPTR " ??\n", addresses[number]);
+  }
+
+  fprintf(stderr, "Resolved %d of %zu addresses\n", result, count);
+
+  ReleaseDebugSnapshot(snapshot);
+  free(addresses);
+  free(results);
+  return EXIT_SUCCESS;
+}